@@ -0,0 +1,1613 @@
+// The parts of the alarm clock that need nothing from wxWidgets: calendar
+// and recurrence arithmetic, the local time zone cache, the timing wheel,
+// CSV records and the encrypting SQLite VFS. main.cpp builds the app on
+// them; tests/alarm_core_test.cpp builds them on their own.
+#ifndef ALARM_CORE_H
+#define ALARM_CORE_H
+
+#include <sqlite3.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// wx/platform.h defines this when wx is included first
+#if defined(__linux__) && !defined(__LINUX__)
+#define __LINUX__
+#endif
+#ifdef __LINUX__
+#include <unistd.h>
+#endif
+
+// Day names as stored in the alarms table, indexed by tm_wday
+static const char* const kDayNames[] = {"Sunday", "Monday", "Tuesday", "Wednesday",
+                                        "Thursday", "Friday", "Saturday"};
+
+// Bit per weekday in tm_wday order
+static const unsigned kEveryDayMask = 0x7F;
+
+enum ClockTimeCheck { ClockTimeOk, ClockTimeMalformed, ClockTimeOutOfRange };
+
+// Validates "HH:MM" with hours in [firstHour, lastHour], as the alarm form
+// and imports require
+static ClockTimeCheck CheckClockTime(const std::string& text, int firstHour, int lastHour,
+                                     int* hours, int* minutes) {
+    if (text.length() != 5 || text[2] != ':' ||
+        !isdigit((unsigned char)text[0]) || !isdigit((unsigned char)text[1]) ||
+        !isdigit((unsigned char)text[3]) || !isdigit((unsigned char)text[4])) {
+        return ClockTimeMalformed;
+    }
+    *hours = (text[0] - '0') * 10 + (text[1] - '0');
+    *minutes = (text[3] - '0') * 10 + (text[4] - '0');
+    if (*hours < firstHour || *hours > lastHour || *minutes > 59) {
+        return ClockTimeOutOfRange;
+    }
+    return ClockTimeOk;
+}
+
+// Calendar arithmetic on days since 1970-01-01 (proleptic Gregorian), after
+// Howard Hinnant's civil-date algorithms
+static int32_t DaysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int yearOfEra = year - era * 400;
+    const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static void CivilFromDays(int32_t days, int* year, int* month, int* day) {
+    days += 719468;
+    const int era = (days >= 0 ? days : days - 146096) / 146097;
+    const int dayOfEra = days - era * 146097;
+    const int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int shiftedMonth = (5 * dayOfYear + 2) / 153;
+    *day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    *month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    *year = yearOfEra + era * 400 + (*month <= 2);
+}
+
+// 0 = Sunday, matching tm_wday
+static int WeekdayFromDays(int32_t days) {
+    return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+static int DaysInMonth(int year, int month) {
+    static const int lengths[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : lengths[month - 1];
+}
+
+// When an alarm repeats. Occurrences are computed in closed form from the
+// rule's anchor day, so finding the next one never steps through time.
+// Rules are stored as an RRULE-style string, e.g.
+// "FREQ=WEEKLY;INTERVAL=2;BYDAY=MO,FR;DTSTART=20240101;EXDATE=20240506".
+struct RecurrenceRule {
+    enum Frequency { Daily, Weekly, Monthly };
+
+    static const int32_t kNever = INT32_MAX;
+
+    Frequency frequency = Weekly;
+    int interval = 1;                   // Every N days, weeks or months
+    unsigned weekdays = kEveryDayMask;  // Weekly days, or the weekday of a monthly nth-weekday rule
+    int monthDay = 0;                   // Monthly: 1-31, -1 for the last day, 0 when using nthWeek
+    int nthWeek = 0;                    // Monthly: 1-5, -1 for the last such weekday
+    int32_t startDay = 0;               // Anchors the interval; no occurrence before it
+    int32_t endDay = kNever;            // Last day an occurrence may fall on
+    std::vector<int32_t> skipDays;      // Sorted
+
+    static RecurrenceRule FromDay(const std::string& day) {
+        RecurrenceRule rule;
+        if (day != "Every Day") {
+            auto it = std::find(std::begin(kDayNames), std::end(kDayNames), day);
+            rule.weekdays = it == std::end(kDayNames) ? 0 : 1u << (it - std::begin(kDayNames));
+        }
+        return rule;
+    }
+
+    // Rules the minute-of-week index can answer on its own
+    bool IsPlainWeekly() const {
+        return frequency == Weekly && interval == 1 && startDay == 0 &&
+               endDay == kNever && skipDays.empty();
+    }
+
+    // First day on or after `from` with an occurrence, or kNever
+    int32_t NextDay(int32_t from) const {
+        from = std::max(from, startDay);
+        for (size_t attempt = 0; attempt <= skipDays.size(); attempt++) {
+            int32_t day = NextCandidate(from);
+            if (day > endDay) {
+                return kNever;
+            }
+            if (!std::binary_search(skipDays.begin(), skipDays.end(), day)) {
+                return day;
+            }
+            from = day + 1;
+        }
+        return kNever;
+    }
+
+    bool Parse(const std::string& text) {
+        *this = RecurrenceRule();
+        frequency = Daily;
+        weekdays = 0;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find(';', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::string part = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            size_t eq = part.find('=');
+            if (eq == std::string::npos) {
+                return false;
+            }
+            std::string key = part.substr(0, eq);
+            std::string value = part.substr(eq + 1);
+            if (key == "FREQ") {
+                if (value == "DAILY") frequency = Daily;
+                else if (value == "WEEKLY") frequency = Weekly;
+                else if (value == "MONTHLY") frequency = Monthly;
+                else return false;
+            } else if (key == "INTERVAL") {
+                interval = atoi(value.c_str());
+            } else if (key == "BYDAY") {
+                if (!ParseWeekdays(value)) return false;
+            } else if (key == "BYMONTHDAY") {
+                monthDay = atoi(value.c_str());
+            } else if (key == "DTSTART") {
+                if (!ParseDate(value, &startDay)) return false;
+            } else if (key == "UNTIL") {
+                if (!ParseDate(value, &endDay)) return false;
+            } else if (key == "EXDATE") {
+                for (size_t from = 0; from < value.size(); ) {
+                    size_t comma = value.find(',', from);
+                    if (comma == std::string::npos) comma = value.size();
+                    int32_t day;
+                    if (!ParseDate(value.substr(from, comma - from), &day)) return false;
+                    skipDays.push_back(day);
+                    from = comma + 1;
+                }
+            } else {
+                return false; // COUNT, BYMONTH, ...: not a rule this class can keep
+            }
+        }
+
+        if (frequency == Daily && weekdays != 0 && interval != 1) {
+            return false; // every other day, but only on Mondays: no plain rule says that
+        }
+        if (frequency == Daily && weekdays != 0) {
+            frequency = Weekly; // FREQ=DAILY;BYDAY=MO,TU is a weekly rule
+        }
+        if (frequency == Weekly && weekdays == 0) {
+            weekdays = 1u << WeekdayFromDays(startDay);
+        }
+        if (frequency == Monthly && monthDay == 0 && nthWeek == 0) {
+            int year, month;
+            CivilFromDays(startDay, &year, &month, &monthDay);
+        }
+        if (frequency == Daily || (frequency == Monthly && monthDay != 0)) {
+            weekdays = kEveryDayMask;
+        }
+        std::sort(skipDays.begin(), skipDays.end());
+        skipDays.erase(std::unique(skipDays.begin(), skipDays.end()), skipDays.end());
+
+        // An nth-weekday rule follows one weekday; "2MO,3TU" or "2MO,TU"
+        // would otherwise be kept as the last ordinal for every day listed
+        bool monthlyOk = monthDay != 0 ? (monthDay >= 1 && monthDay <= 31) || monthDay == -1
+                                       : ((nthWeek >= 1 && nthWeek <= 5) || nthWeek == -1) &&
+                                             (weekdays & (weekdays - 1)) == 0;
+        return interval >= 1 && weekdays != 0 && (frequency != Monthly || monthlyOk);
+    }
+
+    std::string Format() const {
+        static const char* const freqNames[] = {"DAILY", "WEEKLY", "MONTHLY"};
+        std::string text = std::string("FREQ=") + freqNames[frequency];
+        if (interval != 1) {
+            text += ";INTERVAL=" + std::to_string(interval);
+        }
+        if (frequency == Weekly || (frequency == Monthly && monthDay == 0)) {
+            text += ";BYDAY=";
+            if (frequency == Monthly) {
+                text += std::to_string(nthWeek);
+            }
+            for (int day = 0, first = 1; day < 7; day++) {
+                if (weekdays & (1u << day)) {
+                    text += std::string(first ? "" : ",") + kDayCodes[day];
+                    first = 0;
+                }
+            }
+        }
+        if (frequency == Monthly && monthDay != 0) {
+            text += ";BYMONTHDAY=" + std::to_string(monthDay);
+        }
+        if (startDay != 0) {
+            text += ";DTSTART=" + FormatDate(startDay);
+        }
+        if (endDay != kNever) {
+            text += ";UNTIL=" + FormatDate(endDay);
+        }
+        for (size_t i = 0; i < skipDays.size(); i++) {
+            text += (i == 0 ? ";EXDATE=" : ",") + FormatDate(skipDays[i]);
+        }
+        return text;
+    }
+
+    static bool ParseDate(const std::string& text, int32_t* day) {
+        int year, month, dayOfMonth;
+        if (text.size() < 8 || sscanf(text.c_str(), "%4d%2d%2d", &year, &month, &dayOfMonth) != 3 ||
+            month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > DaysInMonth(year, month)) {
+            return false;
+        }
+        *day = DaysFromCivil(year, month, dayOfMonth);
+        return true;
+    }
+
+    static std::string FormatDate(int32_t day) {
+        int year, month, dayOfMonth;
+        CivilFromDays(day, &year, &month, &dayOfMonth);
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%04d%02d%02d", year, month, dayOfMonth);
+        return buffer;
+    }
+
+private:
+    static constexpr const char* kDayCodes[7] = {"SU", "MO", "TU", "WE", "TH", "FR", "SA"};
+
+    bool ParseWeekdays(const std::string& value) {
+        for (size_t from = 0; from < value.size(); ) {
+            size_t comma = value.find(',', from);
+            if (comma == std::string::npos) comma = value.size();
+            std::string item = value.substr(from, comma - from);
+            from = comma + 1;
+            if (item.size() < 2) {
+                return false;
+            }
+            if (item.size() > 2) {
+                nthWeek = atoi(item.c_str()); // "2MO", "-1FR"
+            }
+            std::string code = item.substr(item.size() - 2);
+            auto it = std::find_if(std::begin(kDayCodes), std::end(kDayCodes),
+                                   [&](const char* c) { return code == c; });
+            if (it == std::end(kDayCodes)) {
+                return false;
+            }
+            weekdays |= 1u << (it - std::begin(kDayCodes));
+        }
+        return true;
+    }
+
+    int32_t NextCandidate(int32_t from) const {
+        switch (frequency) {
+        case Daily: {
+            int32_t periods = (from - startDay + interval - 1) / interval;
+            return startDay + periods * interval;
+        }
+        case Weekly: {
+            // Weeks run Sunday to Saturday, counted from the one holding startDay
+            int32_t weekStart = startDay - WeekdayFromDays(startDay);
+            int32_t week = (from - weekStart) / 7;
+            int dayOfWeek = (from - weekStart) % 7;
+            if (week % interval != 0) {
+                week += interval - week % interval;
+                dayOfWeek = 0;
+            }
+            unsigned remaining = weekdays & (kEveryDayMask << dayOfWeek) & kEveryDayMask;
+            if (remaining == 0) {
+                week += interval;
+                remaining = weekdays;
+            }
+            return weekStart + week * 7 + __builtin_ctz(remaining);
+        }
+        case Monthly: {
+            int startYear, startMonth, unusedDay;
+            CivilFromDays(startDay, &startYear, &startMonth, &unusedDay);
+            int year, month, dayOfMonth;
+            CivilFromDays(from, &year, &month, &dayOfMonth);
+            int months = (year - startYear) * 12 + (month - startMonth);
+            months += (interval - months % interval) % interval;
+            // Months lacking the day (the 31st, a fifth Monday) are skipped;
+            // a few years of them means the rule can never fire
+            for (int attempt = 0; attempt < 48; attempt++, months += interval) {
+                int candidateYear = startYear + (startMonth - 1 + months) / 12;
+                int candidateMonth = (startMonth - 1 + months) % 12 + 1;
+                int day = DayInMonth(candidateYear, candidateMonth);
+                if (day != 0) {
+                    int32_t candidate = DaysFromCivil(candidateYear, candidateMonth, day);
+                    if (candidate >= from) {
+                        return candidate;
+                    }
+                }
+            }
+            return kNever;
+        }
+        }
+        return kNever;
+    }
+
+    // Day of the month this rule picks, or 0 if the month has no such day
+    int DayInMonth(int year, int month) const {
+        int length = DaysInMonth(year, month);
+        if (monthDay != 0) {
+            return monthDay == -1 ? length : (monthDay <= length ? monthDay : 0);
+        }
+        int weekday = __builtin_ctz(weekdays);
+        int first = 1 + (weekday - WeekdayFromDays(DaysFromCivil(year, month, 1)) + 7) % 7;
+        if (nthWeek == -1) {
+            return first + (length - first) / 7 * 7;
+        }
+        int day = first + (nthWeek - 1) * 7;
+        return day <= length ? day : 0;
+    }
+};
+
+static int64_t FloorDiv(int64_t value, int64_t divisor) {
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// Cached view of the local time zone: the UTC offsets in force from a week
+// ago to a year ahead and the instants they change, so converting between
+// epoch seconds and local wall-clock minutes is plain arithmetic instead of
+// localtime()/mktime(), which lock and may stat /etc/localtime every call.
+// Refreshed once a transition has passed or the system zone changes.
+class LocalTimeZone {
+public:
+    LocalTimeZone() {
+        Refresh(time(0));
+    }
+
+    void Refresh(time_t now) {
+        const time_t day = 24 * 60 * 60;
+        tzset();
+        spans.clear();
+        coveredFrom = now - 8 * day;
+        coveredUntil = now + 400 * day;
+
+        long offset = LibcOffset(coveredFrom);
+        spans.push_back({coveredFrom, offset});
+        refreshAt = now + 180 * day;
+        for (time_t probe = coveredFrom; probe < coveredUntil; probe += day) {
+            long next = LibcOffset(probe + day);
+            if (next == offset) {
+                continue;
+            }
+            // Narrow the change down to the exact second
+            time_t low = probe, high = probe + day;
+            while (high - low > 1) {
+                time_t mid = low + (high - low) / 2;
+                (LibcOffset(mid) == offset ? low : high) = mid;
+            }
+            spans.push_back({high, next});
+            if (high > now) {
+                refreshAt = std::min(refreshAt, high);
+            }
+            offset = next;
+        }
+    }
+
+    // Cheap enough to call on every wakeup
+    void Advance(time_t now) {
+        if (now >= refreshAt) {
+            Refresh(now);
+        }
+    }
+
+    // Seconds east of UTC in force at `when`
+    long OffsetAt(time_t when) const {
+        if (when < coveredFrom || when >= coveredUntil) {
+            return LibcOffset(when);
+        }
+        size_t i = spans.size() - 1;
+        while (spans[i].begin > when) {
+            i--;
+        }
+        return spans[i].offset;
+    }
+
+    // Minutes since 1970-01-01 00:00 local time
+    int64_t LocalMinute(time_t when) const {
+        return FloorDiv((int64_t)when + OffsetAt(when), 60);
+    }
+
+    int32_t LocalDay(time_t when) const {
+        return (int32_t)FloorDiv(LocalMinute(when), 24 * 60);
+    }
+
+    // Instant a local wall-clock minute begins. Minutes skipped by a spring-
+    // forward transition map to the transition itself (a 02:30 alarm rings
+    // at 03:00); minutes repeated by a fall-back one map to their first
+    // occurrence so they fire once.
+    time_t ToUtc(int64_t localMinute) const {
+        int64_t localSeconds = localMinute * 60;
+        for (size_t i = 0; i < spans.size(); i++) {
+            time_t end = i + 1 < spans.size() ? spans[i + 1].begin : coveredUntil;
+            time_t candidate = (time_t)(localSeconds - spans[i].offset);
+            if (candidate < spans[i].begin) {
+                if (i > 0) {
+                    return spans[i].begin;
+                }
+                break;
+            }
+            if (candidate < end) {
+                return candidate;
+            }
+        }
+
+        // Outside the cached range
+        tm local = {};
+        int year, month;
+        int32_t day = (int32_t)FloorDiv(localMinute, 24 * 60);
+        CivilFromDays(day, &year, &month, &local.tm_mday);
+        local.tm_year = year - 1900;
+        local.tm_mon = month - 1;
+        local.tm_min = (int)(localMinute - (int64_t)day * 24 * 60);
+        local.tm_isdst = -1;
+        return mktime(&local);
+    }
+
+private:
+    struct Span {
+        time_t begin;
+        long offset;
+    };
+
+    static long LibcOffset(time_t when) {
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &when);
+#else
+        localtime_r(&when, &local);
+#endif
+        int64_t localSeconds = (int64_t)DaysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400 +
+                               local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+        return (long)(localSeconds - when);
+    }
+
+    std::vector<Span> spans;
+    time_t coveredFrom = 0;
+    time_t coveredUntil = 0;
+    time_t refreshAt = 0;
+};
+
+// Index of the lowest set bit; 64 when none is
+static int LowestBit(uint64_t bits) {
+    return bits ? __builtin_ctzll(bits) : 64;
+}
+
+// Hierarchical timing wheel for one-shot timers (snoozes, countdowns),
+// counted in whole seconds of a monotonic clock. Four levels of slots cover
+// seconds of the current minute, minutes of the current hour, hours of the
+// current day and the next 64 days; timers further out wait in the top
+// level and are re-filed as their slot comes round. A timer moves down a
+// level at most three times, so adding, cancelling and expiring one are all
+// constant time, and occupancy bitmaps let the owner sleep until the next
+// non-empty slot instead of ticking every second.
+class TimingWheel {
+public:
+    typedef uint64_t Handle; // Never 0
+
+    TimingWheel() {
+        Reset(0);
+    }
+
+    void Reset(int64_t now) {
+        nodes.clear();
+        freeNode = -1;
+        live = 0;
+        current = now;
+        std::fill(std::begin(slotHead), std::end(slotHead), -1);
+        std::fill(std::begin(occupied), std::end(occupied), 0);
+    }
+
+    size_t Size() const {
+        return live;
+    }
+
+    // Adds a timer expiring at tick `expires`; `now` lets an idle wheel catch up
+    Handle Add(int64_t expires, int64_t now) {
+        if (live == 0) {
+            current = std::max(current, now);
+        }
+        int32_t node;
+        if (freeNode != -1) {
+            node = freeNode;
+            freeNode = nodes[node].next;
+        } else {
+            node = (int32_t)nodes.size();
+            nodes.push_back(Node());
+        }
+        nodes[node].expires = std::max(expires, current + 1);
+        File(node);
+        live++;
+        return (Handle)nodes[node].generation << 32 | (uint32_t)node;
+    }
+
+    // Returns false if the timer already expired or was cancelled
+    bool Cancel(Handle handle) {
+        uint32_t node = (uint32_t)handle;
+        if (node >= nodes.size() || nodes[node].generation != (uint32_t)(handle >> 32) || nodes[node].slot < 0) {
+            return false;
+        }
+        Unlink(node);
+        Release(node);
+        return true;
+    }
+
+    // First tick at which a slot needs attention, or -1 when empty
+    int64_t NextTick() const {
+        if (live == 0) {
+            return -1;
+        }
+        uint64_t pending = occupied[0] & (~0ull << (current % 60 + 1));
+        if (pending) {
+            return current - current % 60 + LowestBit(pending);
+        }
+        pending = occupied[1] & (~0ull << (current / 60 % 60 + 1));
+        if (pending) {
+            return current - current % 3600 + LowestBit(pending) * 60;
+        }
+        pending = occupied[2] & (~0ull << (current / 3600 % 24 + 1));
+        if (pending) {
+            return current - current % 86400 + LowestBit(pending) * 3600;
+        }
+        int64_t day = current / 86400;
+        int shift = (int)((day + 1) % 64);
+        pending = shift ? (occupied[3] >> shift | occupied[3] << (64 - shift)) : occupied[3];
+        return (day + 1 + LowestBit(pending)) * 86400;
+    }
+
+    // Expires every timer due at or before `now`, calling onExpire(handle).
+    // onExpire must not add or cancel timers.
+    template <typename Fn>
+    void Advance(int64_t now, Fn onExpire) {
+        for (;;) {
+            int64_t tick = NextTick();
+            if (tick == -1 || tick > now) {
+                break;
+            }
+            current = tick;
+            if (tick % 86400 == 0) {
+                Cascade(kLevelBase[3] + (int)(tick / 86400 % 64));
+            }
+            if (tick % 3600 == 0) {
+                Cascade(kLevelBase[2] + (int)(tick / 3600 % 24));
+            }
+            if (tick % 60 == 0) {
+                Cascade(kLevelBase[1] + (int)(tick / 60 % 60));
+            }
+            for (int32_t node = Detach((int)(tick % 60)); node != -1; ) {
+                int32_t next = nodes[node].next;
+                Handle handle = (Handle)nodes[node].generation << 32 | (uint32_t)node;
+                Release(node);
+                onExpire(handle);
+                node = next;
+            }
+        }
+        current = std::max(current, now);
+    }
+
+private:
+    static const int kLevelBase[4];
+    static const int kSlots = 60 + 60 + 24 + 64;
+
+    struct Node {
+        int64_t expires = 0;
+        int32_t prev = -1;
+        int32_t next = -1;
+        uint32_t generation = 1;
+        int16_t slot = -1; // -1 while on the free list
+    };
+
+    static int LevelOf(int slot) {
+        return slot < kLevelBase[1] ? 0 : slot < kLevelBase[2] ? 1 : slot < kLevelBase[3] ? 2 : 3;
+    }
+
+    // Files a node into the lowest level whose span still holds its expiry
+    void File(int32_t node) {
+        int64_t expires = nodes[node].expires;
+        int slot;
+        if (expires / 60 == current / 60) {
+            slot = kLevelBase[0] + (int)(expires % 60);
+        } else if (expires / 3600 == current / 3600) {
+            slot = kLevelBase[1] + (int)(expires / 60 % 60);
+        } else if (expires / 86400 == current / 86400) {
+            slot = kLevelBase[2] + (int)(expires / 3600 % 24);
+        } else {
+            slot = kLevelBase[3] + (int)(expires / 86400 % 64);
+        }
+
+        int level = LevelOf(slot);
+        nodes[node].slot = (int16_t)slot;
+        nodes[node].prev = -1;
+        nodes[node].next = slotHead[slot];
+        if (slotHead[slot] != -1) {
+            nodes[slotHead[slot]].prev = node;
+        }
+        slotHead[slot] = node;
+        occupied[level] |= 1ull << (slot - kLevelBase[level]);
+    }
+
+    void Unlink(int32_t node) {
+        Node& entry = nodes[node];
+        if (entry.prev != -1) {
+            nodes[entry.prev].next = entry.next;
+        } else {
+            slotHead[entry.slot] = entry.next;
+            if (entry.next == -1) {
+                int level = LevelOf(entry.slot);
+                occupied[level] &= ~(1ull << (entry.slot - kLevelBase[level]));
+            }
+        }
+        if (entry.next != -1) {
+            nodes[entry.next].prev = entry.prev;
+        }
+    }
+
+    void Release(int32_t node) {
+        nodes[node].slot = -1;
+        nodes[node].generation = nodes[node].generation == UINT32_MAX ? 1 : nodes[node].generation + 1;
+        nodes[node].next = freeNode;
+        freeNode = node;
+        live--;
+    }
+
+    // Empties a slot, returning its former list
+    int32_t Detach(int slot) {
+        int level = LevelOf(slot);
+        int32_t head = slotHead[slot];
+        slotHead[slot] = -1;
+        occupied[level] &= ~(1ull << (slot - kLevelBase[level]));
+        return head;
+    }
+
+    // Re-files a higher level slot whose time has come
+    void Cascade(int slot) {
+        for (int32_t node = Detach(slot); node != -1; ) {
+            int32_t next = nodes[node].next;
+            File(node);
+            node = next;
+        }
+    }
+
+    std::vector<Node> nodes;
+    int32_t freeNode = -1;
+    size_t live = 0;
+    int64_t current = 0; // Last tick processed
+    int32_t slotHead[kSlots];
+    uint64_t occupied[4];
+};
+
+const int TimingWheel::kLevelBase[4] = {0, 60, 120, 144};
+
+static bool ReadLine(FILE* in, std::string* line) {
+    line->clear();
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), in)) {
+        line->append(buffer);
+        if (line->back() == '\n') {
+            break;
+        }
+    }
+    if (line->empty()) {
+        return false;
+    }
+    while (!line->empty() && (line->back() == '\n' || line->back() == '\r')) {
+        line->pop_back();
+    }
+    return true;
+}
+
+// One CSV record, reading on while a quoted field is still open and
+// keeping the newlines; `*lines` is how many lines the record took
+static bool ReadCsvRecord(FILE* in, std::string* record, int* lines) {
+    if (!ReadLine(in, record)) {
+        return false;
+    }
+    *lines = 1;
+    // Doubled quotes inside a field count twice, so an odd count means one is open
+    size_t quotes = std::count(record->begin(), record->end(), '"');
+    std::string more;
+    while (quotes % 2 != 0 && ReadLine(in, &more)) {
+        quotes += std::count(more.begin(), more.end(), '"');
+        *record += '\n';
+        *record += more;
+        (*lines)++;
+    }
+    return true;
+}
+
+// Comma separated, with "quoted, fields" and "" for a quote inside one
+static void SplitCsv(const std::string& line, std::vector<std::string>* fields) {
+    fields->clear();
+    fields->emplace_back();
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields->back() += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                fields->back() += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields->emplace_back();
+        } else {
+            fields->back() += c;
+        }
+    }
+}
+
+// A time,day[,recurrence[,label]] record as an alarm time and rule, checked
+// the way the alarm form checks them. `dayMask` is the day column already
+// read; a recurrence, when given, takes its place. `*minuteOfDay` is 0 for
+// a rejected record.
+static bool ParseCsvAlarm(const std::vector<std::string>& fields, unsigned dayMask, int* minuteOfDay,
+                          RecurrenceRule* rule) {
+    int hours = 0, minutes = 0;
+    *rule = RecurrenceRule();
+    bool valid = fields.size() >= 2 && CheckClockTime(fields[0], 0, 23, &hours, &minutes) == ClockTimeOk;
+    if (valid && fields.size() >= 3 && !fields[2].empty()) {
+        valid = rule->Parse(fields[2]);
+    } else if (valid) {
+        rule->weekdays = dayMask;
+        valid = dayMask != 0;
+    }
+    *minuteOfDay = valid ? hours * 60 + minutes : 0;
+    return valid;
+}
+
+// SQLite VFS that keeps database pages encrypted at rest with AES-256-GCM.
+// It sits on top of the platform VFS and encrypts the main database file
+// and its WAL for every path given a key with SetKey(); other files, and
+// databases without a key, pass through untouched. Every page ends in
+// kReserve bytes of SQLite's per-page reserved space, holding its IV (a
+// random per-open prefix and a write counter) and the GCM tag. The page's
+// file offset is authenticated along with it, so pages can't be altered or
+// moved around without failing to read. While the key is being rotated a
+// database has a previous key too; pages are written under the new one and
+// read under whichever their tag verifies with.
+class EncryptedVfs {
+public:
+    static const int kPageSize = 4096;
+    static const int kReserve = 12 + 16; // IV and GCM tag
+    static const int kKeySize = 32;
+
+    static const char* Name() {
+        return "alarm-aes";
+    }
+
+    // Registers the VFS on first use and sets the key for the database at
+    // `path`, with `previous` while pages may still be under an older key.
+    // Connections already open pick the change up on their next read.
+    static bool SetKey(const char* path, const unsigned char* key, const unsigned char* previous = nullptr) {
+        std::string fullPath;
+        std::lock_guard<std::mutex> lock(Mutex());
+        if (!Register() || !FullPath(path, &fullPath)) {
+            return false;
+        }
+        Keyring& ring = Keys()[fullPath];
+        ring.key.assign(key, key + kKeySize);
+        OPENSSL_cleanse(ring.previous.data(), ring.previous.size());
+        ring.previous.clear();
+        if (previous) {
+            ring.previous.assign(previous, previous + kKeySize);
+        }
+        KeysVersion()++;
+        return true;
+    }
+
+    static void RemoveKey(const char* path) {
+        std::string fullPath;
+        std::lock_guard<std::mutex> lock(Mutex());
+        auto it = FullPath(path, &fullPath) ? Keys().find(fullPath) : Keys().end();
+        if (it != Keys().end()) {
+            OPENSSL_cleanse(it->second.key.data(), it->second.key.size());
+            OPENSSL_cleanse(it->second.previous.data(), it->second.previous.size());
+            Keys().erase(it);
+            KeysVersion()++;
+        }
+    }
+
+    // Forgets the previous key of `path` once no page is left under it
+    static void DropPreviousKey(const char* path) {
+        std::string fullPath;
+        std::lock_guard<std::mutex> lock(Mutex());
+        auto it = FullPath(path, &fullPath) ? Keys().find(fullPath) : Keys().end();
+        if (it != Keys().end() && !it->second.previous.empty()) {
+            OPENSSL_cleanse(it->second.previous.data(), it->second.previous.size());
+            it->second.previous.clear();
+            KeysVersion()++;
+        }
+    }
+
+    // Puts back the pages of a Rekeyer batch a crash interrupted. Call
+    // before opening the database.
+    static bool Recover(const char* path) {
+        std::string fullPath;
+        std::lock_guard<std::mutex> lock(Mutex());
+        if (!FullPath(path, &fullPath)) {
+            return false;
+        }
+        std::string journalPath = fullPath + "-rekey";
+        FILE* journal = fopen(journalPath.c_str(), "rb");
+        if (!journal) {
+            return true;
+        }
+        JournalHeader header;
+        std::vector<unsigned char> pages;
+        bool complete = fread(&header, sizeof(header), 1, journal) == 1 &&
+                        memcmp(header.magic, kJournalMagic, sizeof(header.magic)) == 0 &&
+                        header.pages > 0 && header.pages <= kMaxBatchPages;
+        if (complete) {
+            pages.resize((size_t)header.pages * kPageSize);
+            unsigned char digest[sizeof(header.digest)];
+            complete = fread(pages.data(), pages.size(), 1, journal) == 1 &&
+                       JournalDigest(header, pages.data(), digest) &&
+                       memcmp(digest, header.digest, sizeof(digest)) == 0;
+        }
+        fclose(journal);
+
+        // An incomplete journal was never synced, so the database was not touched
+        bool ok = true;
+        if (complete) {
+            FILE* database = fopen(fullPath.c_str(), "r+b");
+            ok = database && fseek(database, (long)header.offset, SEEK_SET) == 0 &&
+                 fwrite(pages.data(), pages.size(), 1, database) == 1 && fflush(database) == 0;
+#ifdef __LINUX__
+            ok = ok && fsync(fileno(database)) == 0;
+#endif
+            if (database) {
+                ok = fclose(database) == 0 && ok;
+            }
+        }
+        return ok && remove(journalPath.c_str()) == 0;
+    }
+
+private:
+    static const int kIvSize = 12;
+    static const int kTagSize = 16;
+    static const int kWalHeaderSize = 32;
+    static const int kWalFrameHeaderSize = 24;
+    static const uint32_t kMaxBatchPages = 16384;
+    static constexpr const char* kJournalMagic = "ALRMRKJ1";
+
+    struct Keyring {
+        std::vector<unsigned char> key;
+        std::vector<unsigned char> previous; // Empty unless rotating
+        uint64_t writes = 0;         // To the database file; a Rekeyer batch read before one is stale
+        bool rekeyUnsynced = false;  // A Rekeyer batch is written back but not yet synced
+    };
+
+    // Followed in memory by the underlying VFS's file
+    struct File {
+        sqlite3_file base;
+        sqlite3_file* real;
+        const char* keyPath;     // Database whose keys apply; null when the file passes through
+        unsigned keysVersion;    // KeysVersion() the contexts were set up for
+        EVP_CIPHER_CTX* encrypt;
+        EVP_CIPHER_CTX* decrypt;
+        EVP_CIPHER_CTX* decryptPrevious; // Only while the key is being rotated
+        unsigned char* scratch;  // Two pages
+        unsigned char nonce[12]; // Next IV: 8 random bytes, then a counter
+        bool isWal;
+    };
+
+    // A batch of pages as they were before a Rekeyer step
+    struct JournalHeader {
+        unsigned char magic[8];
+        uint64_t offset;
+        uint32_t pages;
+        uint32_t reserved;
+        unsigned char digest[32]; // SHA-256 of the fields above and the pages
+    };
+
+    // Guards the key registry and all page I/O on encrypted files
+    static std::mutex& Mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::map<std::string, Keyring>& Keys() {
+        static std::map<std::string, Keyring> keys;
+        return keys;
+    }
+
+    static unsigned& KeysVersion() {
+        static unsigned version = 1;
+        return version;
+    }
+
+    static sqlite3_vfs* Real(sqlite3_vfs* vfs) {
+        return static_cast<sqlite3_vfs*>(vfs->pAppData);
+    }
+
+    static sqlite3_file* Real(sqlite3_file* file) {
+        return reinterpret_cast<File*>(file)->real;
+    }
+
+    static bool FullPath(const char* path, std::string* fullPath) {
+        sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+        std::vector<char> buffer(real->mxPathname + 1);
+        if (real->xFullPathname(real, path, (int)buffer.size(), buffer.data()) != SQLITE_OK) {
+            return false;
+        }
+        *fullPath = buffer.data();
+        return true;
+    }
+
+    static bool JournalDigest(const JournalHeader& header, const unsigned char* pages, unsigned char* digest) {
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        bool ok = ctx && EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1 &&
+                  EVP_DigestUpdate(ctx, &header, offsetof(JournalHeader, digest)) == 1 &&
+                  EVP_DigestUpdate(ctx, pages, (size_t)header.pages * kPageSize) == 1 &&
+                  EVP_DigestFinal_ex(ctx, digest, nullptr) == 1;
+        EVP_MD_CTX_free(ctx);
+        return ok;
+    }
+
+public:
+    // Re-encrypts the pages of an open database under its current key, a
+    // batch at a time, with the batch split between a thread per core.
+    // Each batch is journaled first, and holds off every connection's page
+    // I/O until it is back on disk.
+    class Rekeyer {
+    public:
+        static const int kBatchPages = 1024;
+
+        // `threads` of 0 means one per core
+        Rekeyer(sqlite3* db, int threads = 0) {
+            sqlite3_file* base = nullptr;
+            sqlite3_file_control(db, "main", SQLITE_FCNTL_FILE_POINTER, &base);
+            if (base && base->pMethods == &kMethods && reinterpret_cast<File*>(base)->keyPath &&
+                !reinterpret_cast<File*>(base)->isWal) {
+                file = reinterpret_cast<File*>(base);
+                journalPath = std::string(file->keyPath) + "-rekey";
+            }
+            if (threads <= 0) {
+                threads = std::min(std::max((int)std::thread::hardware_concurrency(), 1), 8);
+            }
+            for (int i = 0; i < threads; i++) {
+                slices.emplace_back(new Slice());
+            }
+            // The calling thread takes the first slice itself
+            for (int i = 1; i < threads; i++) {
+                try {
+                    workers.emplace_back(&Rekeyer::Work, this, i);
+                } catch (const std::system_error&) {
+                    slices.resize(workers.size() + 1);
+                    break;
+                }
+            }
+        }
+
+        ~Rekeyer() {
+            {
+                std::lock_guard<std::mutex> lock(batchLock);
+                stopping = true;
+                work.notify_all();
+            }
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        }
+
+        bool IsOk() const {
+            return file != nullptr;
+        }
+
+        int Threads() const {
+            return (int)slices.size();
+        }
+
+        int64_t PageCount() {
+            sqlite3_int64 size = 0;
+            std::lock_guard<std::mutex> lock(Mutex());
+            if (!file || file->real->pMethods->xFileSize(file->real, &size) != SQLITE_OK) {
+                return -1;
+            }
+            return size / kPageSize;
+        }
+
+        // Re-encrypts up to `pages` pages from page index `*cursor`, moving
+        // it past them; a failure leaves the database as it was. Mutex() is
+        // held only to read the batch and to write it back, not across the
+        // fsyncs; a batch SQLite wrote to meanwhile is left for the next call.
+        bool Step(int64_t* cursor, int pages = kBatchPages) {
+            sqlite3_int64 offset;
+            int count;
+            uint64_t writes;
+            {
+                std::lock_guard<std::mutex> vfsLock(Mutex());
+                sqlite3_int64 size;
+                auto ring = file ? Keys().find(file->keyPath) : Keys().end();
+                if (ring == Keys().end() || file->real->pMethods->xFileSize(file->real, &size) != SQLITE_OK) {
+                    return false;
+                }
+                count = (int)std::min<int64_t>(std::min(pages, (int)kMaxBatchPages), size / kPageSize - *cursor);
+                if (count <= 0) {
+                    return true;
+                }
+                if (keysVersion != KeysVersion()) {
+                    for (auto& slice : slices) {
+                        if (!slice->SetKeys(ring->second)) {
+                            return false;
+                        }
+                    }
+                    keysVersion = KeysVersion();
+                }
+                offset = *cursor * kPageSize;
+                batch.resize((size_t)count * kPageSize);
+                if (!Transfer(false, offset, count)) {
+                    return false;
+                }
+                writes = ring->second.writes;
+            }
+            if (!WriteJournal(offset, count)) {
+                return false;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(batchLock);
+                batchOffset = offset;
+                batchPages = count;
+                failed = false;
+                running = (int)workers.size();
+                generation++;
+                work.notify_all();
+            }
+            bool ok = Run(0);
+            {
+                std::unique_lock<std::mutex> lock(batchLock);
+                while (running > 0) {
+                    done.wait(lock);
+                }
+                ok = ok && !failed;
+            }
+            if (!ok) {
+                remove(journalPath.c_str());
+                return false;
+            }
+
+            {
+                std::lock_guard<std::mutex> vfsLock(Mutex());
+                auto ring = Keys().find(file->keyPath);
+                if (ring == Keys().end() || ring->second.writes != writes || keysVersion != KeysVersion()) {
+                    remove(journalPath.c_str());
+                    return ring != Keys().end();
+                }
+                // A failed write leaves the journal behind for Recover()
+                if (!Transfer(true, offset, count)) {
+                    return false;
+                }
+                ring->second.rekeyUnsynced = true;
+            }
+            ok = file->real->pMethods->xSync(file->real, SQLITE_SYNC_NORMAL) == SQLITE_OK;
+            {
+                std::lock_guard<std::mutex> vfsLock(Mutex());
+                auto ring = Keys().find(file->keyPath);
+                if (ring != Keys().end()) {
+                    ring->second.rekeyUnsynced = false;
+                }
+                if (!ok) {
+                    return false;
+                }
+                remove(journalPath.c_str());
+            }
+            *cursor += count;
+            return true;
+        }
+
+    private:
+        // One thread's cipher contexts, kept across batches
+        struct Slice {
+            EVP_CIPHER_CTX* encrypt = EVP_CIPHER_CTX_new();
+            EVP_CIPHER_CTX* decrypt = EVP_CIPHER_CTX_new();
+            EVP_CIPHER_CTX* decryptPrevious = EVP_CIPHER_CTX_new();
+            bool hasPrevious = false;
+            unsigned char nonce[kIvSize];
+            unsigned char backup[kPageSize];
+
+            ~Slice() {
+                EVP_CIPHER_CTX_free(encrypt);
+                EVP_CIPHER_CTX_free(decrypt);
+                EVP_CIPHER_CTX_free(decryptPrevious);
+            }
+
+            bool SetKeys(const Keyring& ring) {
+                hasPrevious = !ring.previous.empty();
+                return encrypt && decrypt && decryptPrevious && RAND_bytes(nonce, sizeof(nonce)) == 1 &&
+                       EVP_EncryptInit_ex(encrypt, EVP_aes_256_gcm(), nullptr, ring.key.data(), nullptr) == 1 &&
+                       EVP_DecryptInit_ex(decrypt, EVP_aes_256_gcm(), nullptr, ring.key.data(), nullptr) == 1 &&
+                       (!hasPrevious || EVP_DecryptInit_ex(decryptPrevious, EVP_aes_256_gcm(), nullptr,
+                                                           ring.previous.data(), nullptr) == 1);
+            }
+
+            // Pages not yet rotated are the likelier ones, so the previous key goes first
+            bool Rekey(unsigned char* page, sqlite3_int64 offset) {
+                if (hasPrevious) {
+                    memcpy(backup, page, kPageSize);
+                    if (Unseal(decryptPrevious, page, offset)) {
+                        return Seal(encrypt, nonce, page, page, offset);
+                    }
+                    memcpy(page, backup, kPageSize);
+                }
+                return Unseal(decrypt, page, offset) && Seal(encrypt, nonce, page, page, offset);
+            }
+        };
+
+        // A worker thread: runs its share of every batch until stopped
+        void Work(int index) {
+            uint64_t seen = 0;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(batchLock);
+                    while (generation == seen && !stopping) {
+                        work.wait(lock);
+                    }
+                    if (stopping) {
+                        break;
+                    }
+                    seen = generation;
+                }
+                bool ok = Run(index);
+                std::lock_guard<std::mutex> lock(batchLock);
+                failed = failed || !ok;
+                if (--running == 0) {
+                    done.notify_one();
+                }
+            }
+        }
+
+        // Re-encrypts the `index`th share of the batch
+        bool Run(int index) {
+            Slice* slice = slices[index].get();
+            int shares = (int)slices.size();
+            int first = (int)((int64_t)batchPages * index / shares);
+            int last = (int)((int64_t)batchPages * (index + 1) / shares);
+            for (int i = first; i < last; i++) {
+                if (!slice->Rekey(batch.data() + (size_t)i * kPageSize, batchOffset + (sqlite3_int64)i * kPageSize)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Reads or writes the batch a page at a time; the platform VFS is
+        // only ever asked for pages by SQLite and caps larger transfers
+        bool Transfer(bool write, sqlite3_int64 offset, int pages) {
+            sqlite3_file* real = file->real;
+            for (int i = 0; i < pages; i++) {
+                unsigned char* page = batch.data() + (size_t)i * kPageSize;
+                sqlite3_int64 at = offset + (sqlite3_int64)i * kPageSize;
+                int rc = write ? real->pMethods->xWrite(real, page, kPageSize, at)
+                               : real->pMethods->xRead(real, page, kPageSize, at);
+                if (rc != SQLITE_OK) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool WriteJournal(sqlite3_int64 offset, int pages) {
+            JournalHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+            header.offset = offset;
+            header.pages = pages;
+            FILE* journal = fopen(journalPath.c_str(), "wb");
+            if (!journal) {
+                return false;
+            }
+            bool ok = JournalDigest(header, batch.data(), header.digest) &&
+                      fwrite(&header, sizeof(header), 1, journal) == 1 &&
+                      fwrite(batch.data(), batch.size(), 1, journal) == 1 && fflush(journal) == 0;
+#ifdef __LINUX__
+            ok = ok && fsync(fileno(journal)) == 0;
+#endif
+            ok = fclose(journal) == 0 && ok;
+            if (!ok) {
+                remove(journalPath.c_str());
+            }
+            return ok;
+        }
+
+        File* file = nullptr;
+        std::string journalPath;
+        unsigned keysVersion = 0;
+        std::vector<std::unique_ptr<Slice>> slices;
+        std::vector<std::thread> workers;
+        std::vector<unsigned char> batch;
+
+        // Guarded by batchLock
+        std::mutex batchLock;
+        std::condition_variable work;
+        std::condition_variable done;
+        uint64_t generation = 0;
+        sqlite3_int64 batchOffset = 0;
+        int batchPages = 0;
+        int running = 0;
+        bool failed = false;
+        bool stopping = false;
+    };
+
+private:
+
+    static bool Register() {
+        static sqlite3_vfs vfs;
+        if (vfs.zName) {
+            return true;
+        }
+        sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+        if (!real) {
+            return false;
+        }
+        vfs.iVersion = 2;
+        vfs.szOsFile = (int)sizeof(File) + real->szOsFile;
+        vfs.mxPathname = real->mxPathname;
+        vfs.zName = Name();
+        vfs.pAppData = real;
+        vfs.xOpen = Open;
+        vfs.xDelete = [](sqlite3_vfs* v, const char* name, int syncDir) {
+            return Real(v)->xDelete(Real(v), name, syncDir);
+        };
+        vfs.xAccess = [](sqlite3_vfs* v, const char* name, int flags, int* result) {
+            return Real(v)->xAccess(Real(v), name, flags, result);
+        };
+        vfs.xFullPathname = [](sqlite3_vfs* v, const char* name, int size, char* out) {
+            return Real(v)->xFullPathname(Real(v), name, size, out);
+        };
+        vfs.xDlOpen = [](sqlite3_vfs* v, const char* name) {
+            return Real(v)->xDlOpen(Real(v), name);
+        };
+        vfs.xDlError = [](sqlite3_vfs* v, int size, char* out) {
+            Real(v)->xDlError(Real(v), size, out);
+        };
+        vfs.xDlSym = [](sqlite3_vfs* v, void* handle, const char* symbol) {
+            return Real(v)->xDlSym(Real(v), handle, symbol);
+        };
+        vfs.xDlClose = [](sqlite3_vfs* v, void* handle) {
+            Real(v)->xDlClose(Real(v), handle);
+        };
+        vfs.xRandomness = [](sqlite3_vfs* v, int size, char* out) {
+            return Real(v)->xRandomness(Real(v), size, out);
+        };
+        vfs.xSleep = [](sqlite3_vfs* v, int microseconds) {
+            return Real(v)->xSleep(Real(v), microseconds);
+        };
+        vfs.xCurrentTime = [](sqlite3_vfs* v, double* now) {
+            return Real(v)->xCurrentTime(Real(v), now);
+        };
+        vfs.xGetLastError = [](sqlite3_vfs* v, int size, char* out) {
+            return Real(v)->xGetLastError ? Real(v)->xGetLastError(Real(v), size, out) : 0;
+        };
+        vfs.xCurrentTimeInt64 = [](sqlite3_vfs* v, sqlite3_int64* now) {
+            return Real(v)->xCurrentTimeInt64(Real(v), now);
+        };
+        if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK) {
+            vfs.zName = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    static int Open(sqlite3_vfs* vfs, const char* name, sqlite3_file* base, int flags, int* outFlags) {
+        File* file = reinterpret_cast<File*>(base);
+        memset(file, 0, sizeof(File));
+        file->real = reinterpret_cast<sqlite3_file*>(file + 1);
+        int rc = Real(vfs)->xOpen(Real(vfs), name, file->real, flags, outFlags);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        file->base.pMethods = &kMethods;
+
+        if (name && (flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_WAL))) {
+            const char* keyPath = flags & SQLITE_OPEN_WAL ? sqlite3_filename_database(name) : name;
+            std::lock_guard<std::mutex> lock(Mutex());
+            if (Keys().count(keyPath)) {
+                file->keyPath = keyPath;
+                file->isWal = (flags & SQLITE_OPEN_WAL) != 0;
+                file->encrypt = EVP_CIPHER_CTX_new();
+                file->decrypt = EVP_CIPHER_CTX_new();
+                file->scratch = static_cast<unsigned char*>(sqlite3_malloc(2 * kPageSize));
+                if (!file->scratch || RAND_bytes(file->nonce, sizeof(file->nonce)) != 1 || !Refresh(file)) {
+                    Close(base);
+                    return SQLITE_NOMEM;
+                }
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    static int Close(sqlite3_file* base) {
+        File* file = reinterpret_cast<File*>(base);
+        int rc = file->real->pMethods ? file->real->pMethods->xClose(file->real) : SQLITE_OK;
+        EVP_CIPHER_CTX_free(file->encrypt);
+        EVP_CIPHER_CTX_free(file->decrypt);
+        EVP_CIPHER_CTX_free(file->decryptPrevious);
+        sqlite3_free(file->scratch);
+        file->encrypt = file->decrypt = file->decryptPrevious = nullptr;
+        file->scratch = nullptr;
+        file->keyPath = nullptr;
+        file->base.pMethods = nullptr;
+        return rc;
+    }
+
+    // Sets the file's contexts up for its database's keys if they changed
+    // since it last looked; called with Mutex() held
+    static bool Refresh(File* file) {
+        if (file->keysVersion == KeysVersion()) {
+            return true;
+        }
+        auto it = Keys().find(file->keyPath);
+        if (it == Keys().end()) {
+            return false;
+        }
+        const Keyring& ring = it->second;
+        if (ring.previous.empty()) {
+            EVP_CIPHER_CTX_free(file->decryptPrevious);
+            file->decryptPrevious = nullptr;
+        } else if (!file->decryptPrevious) {
+            file->decryptPrevious = EVP_CIPHER_CTX_new();
+        }
+        bool ok = file->encrypt && file->decrypt &&
+                  EVP_EncryptInit_ex(file->encrypt, EVP_aes_256_gcm(), nullptr, ring.key.data(), nullptr) == 1 &&
+                  EVP_DecryptInit_ex(file->decrypt, EVP_aes_256_gcm(), nullptr, ring.key.data(), nullptr) == 1 &&
+                  (ring.previous.empty() ||
+                   (file->decryptPrevious && EVP_DecryptInit_ex(file->decryptPrevious, EVP_aes_256_gcm(), nullptr,
+                                                                ring.previous.data(), nullptr) == 1));
+        if (ok) {
+            file->keysVersion = KeysVersion();
+        }
+        return ok;
+    }
+
+    // Offset of the page image a WAL read or write at `offset` starts
+    // with, or -1 for frame and file headers, which stay in the clear
+    static sqlite3_int64 WalPageOffset(sqlite3_int64 offset, int amount) {
+        if (offset < kWalHeaderSize) {
+            return -1;
+        }
+        sqlite3_int64 inFrame = (offset - kWalHeaderSize) % (kWalFrameHeaderSize + kPageSize);
+        if (inFrame == kWalFrameHeaderSize && amount == kPageSize) {
+            return offset; // The page alone
+        }
+        if (inFrame == 0 && amount == kWalFrameHeaderSize + kPageSize) {
+            return offset + kWalFrameHeaderSize; // A whole frame, read during recovery
+        }
+        return -1;
+    }
+
+    static int Read(sqlite3_file* base, void* data, int amount, sqlite3_int64 offset) {
+        File* file = reinterpret_cast<File*>(base);
+        sqlite3_file* real = file->real;
+        unsigned char* out = static_cast<unsigned char*>(data);
+        if (!file->keyPath) {
+            return real->pMethods->xRead(real, data, amount, offset);
+        }
+        std::lock_guard<std::mutex> lock(Mutex());
+        if (!Refresh(file)) {
+            return SQLITE_IOERR_READ;
+        }
+
+        if (file->isWal) {
+            int rc = real->pMethods->xRead(real, data, amount, offset);
+            sqlite3_int64 pageOffset = WalPageOffset(offset, amount);
+            if (rc != SQLITE_OK || pageOffset < 0) {
+                return rc;
+            }
+            return DecryptPage(file, out + (pageOffset - offset), pageOffset);
+        }
+
+        // SQLite reads the database a page at a time, apart from peeking at
+        // the header; those reads decrypt the whole page and copy out
+        sqlite3_int64 pageOffset = offset - offset % kPageSize;
+        if (offset == pageOffset && amount == kPageSize) {
+            int rc = real->pMethods->xRead(real, data, amount, offset);
+            return rc == SQLITE_OK ? DecryptPage(file, out, offset) : rc;
+        }
+        if (offset + amount > pageOffset + kPageSize) {
+            return SQLITE_IOERR_READ;
+        }
+        int rc = real->pMethods->xRead(real, file->scratch, kPageSize, pageOffset);
+        if (rc == SQLITE_IOERR_SHORT_READ) {
+            memset(out, 0, amount);
+        }
+        if (rc == SQLITE_OK && (rc = DecryptPage(file, file->scratch, pageOffset)) == SQLITE_OK) {
+            memcpy(out, file->scratch + (offset - pageOffset), amount);
+        }
+        return rc;
+    }
+
+    static int Write(sqlite3_file* base, const void* data, int amount, sqlite3_int64 offset) {
+        File* file = reinterpret_cast<File*>(base);
+        sqlite3_file* real = file->real;
+        const unsigned char* page = static_cast<const unsigned char*>(data);
+        if (!file->keyPath || (file->isWal && WalPageOffset(offset, amount) != offset)) {
+            return real->pMethods->xWrite(real, data, amount, offset);
+        }
+        // A partial page, or a page without room for the IV and tag, could
+        // only be stored in the clear
+        if (!file->isWal && (amount != kPageSize || offset % kPageSize != 0 ||
+                             (offset == 0 && page[20] < kReserve))) {
+            return SQLITE_IOERR_WRITE;
+        }
+        std::lock_guard<std::mutex> lock(Mutex());
+        if (!Refresh(file) || !Seal(file->encrypt, file->nonce, page, file->scratch, offset)) {
+            return SQLITE_IOERR_WRITE;
+        }
+        if (!file->isWal && !NoteDatabaseWrite(file)) {
+            return SQLITE_IOERR_WRITE;
+        }
+        return real->pMethods->xWrite(real, file->scratch, kPageSize, offset);
+    }
+
+    // Called with Mutex() held before the database file itself changes. A
+    // Rekeyer batch written back but not yet synced is synced here first:
+    // once this write lands, its journal must no longer be replayed.
+    static bool NoteDatabaseWrite(File* file) {
+        Keyring& ring = Keys()[file->keyPath];
+        ring.writes++;
+        if (!ring.rekeyUnsynced) {
+            return true;
+        }
+        if (file->real->pMethods->xSync(file->real, SQLITE_SYNC_NORMAL) != SQLITE_OK) {
+            return false;
+        }
+        ring.rekeyUnsynced = false;
+        remove((std::string(file->keyPath) + "-rekey").c_str());
+        return true;
+    }
+
+    // Decrypts `page` in place, under the previous key if the current one
+    // fails. SQLite leaves the reserved bytes zero and checksums WAL frames
+    // with them, so they read back as zeros too.
+    static int DecryptPage(File* file, unsigned char* page, sqlite3_int64 offset) {
+        unsigned char* backup = file->scratch + kPageSize;
+        if (file->decryptPrevious) {
+            memcpy(backup, page, kPageSize);
+        }
+        bool ok = Unseal(file->decrypt, page, offset);
+        if (!ok && file->decryptPrevious) {
+            memcpy(page, backup, kPageSize);
+            ok = Unseal(file->decryptPrevious, page, offset);
+        }
+        memset(page + kPageSize - kReserve, 0, kReserve);
+        return ok ? SQLITE_OK : SQLITE_IOERR_DATA;
+    }
+
+    // Encrypts `page` into `out`, which may be the same page
+    static bool Seal(EVP_CIPHER_CTX* ctx, unsigned char* nonce, const unsigned char* page, unsigned char* out,
+                     sqlite3_int64 offset) {
+        const int dataSize = kPageSize - kReserve;
+        unsigned char* iv = out + dataSize;
+        unsigned char position[8];
+        for (int i = 0; i < 8; i++) {
+            position[i] = (unsigned char)(offset >> (8 * i));
+        }
+        // A fresh random prefix whenever the counter wraps keeps IVs unique
+        for (int i = kIvSize - 1; i >= 8 && ++nonce[i] == 0; i--) {
+            if (i == 8 && RAND_bytes(nonce, 8) != 1) {
+                return false;
+            }
+        }
+        memcpy(iv, nonce, kIvSize);
+        int length;
+        return EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, iv) == 1 &&
+               EVP_EncryptUpdate(ctx, nullptr, &length, position, sizeof(position)) == 1 &&
+               EVP_EncryptUpdate(ctx, out, &length, page, dataSize) == 1 &&
+               EVP_EncryptFinal_ex(ctx, out + length, &length) == 1 &&
+               EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, kTagSize, iv + kIvSize) == 1;
+    }
+
+    // Decrypts `page` in place; false if its tag doesn't verify under the context's key
+    static bool Unseal(EVP_CIPHER_CTX* ctx, unsigned char* page, sqlite3_int64 offset) {
+        const int dataSize = kPageSize - kReserve;
+        unsigned char* iv = page + dataSize;
+        unsigned char position[8];
+        for (int i = 0; i < 8; i++) {
+            position[i] = (unsigned char)(offset >> (8 * i));
+        }
+        int length;
+        return EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, iv) == 1 &&
+               EVP_DecryptUpdate(ctx, nullptr, &length, position, sizeof(position)) == 1 &&
+               EVP_DecryptUpdate(ctx, page, &length, page, dataSize) == 1 &&
+               EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, kTagSize, iv + kIvSize) == 1 &&
+               EVP_DecryptFinal_ex(ctx, page + length, &length) == 1;
+    }
+
+    static const sqlite3_io_methods kMethods;
+};
+
+const sqlite3_io_methods EncryptedVfs::kMethods = {
+    3,
+    EncryptedVfs::Close,
+    EncryptedVfs::Read,
+    EncryptedVfs::Write,
+    [](sqlite3_file* f, sqlite3_int64 size) {
+        File* file = reinterpret_cast<File*>(f);
+        if (file->keyPath) {
+            std::lock_guard<std::mutex> lock(Mutex());
+            if (!file->isWal && !NoteDatabaseWrite(file)) {
+                return SQLITE_IOERR_TRUNCATE;
+            }
+            return Real(f)->pMethods->xTruncate(Real(f), size);
+        }
+        return Real(f)->pMethods->xTruncate(Real(f), size);
+    },
+    [](sqlite3_file* f, int flags) {
+        return Real(f)->pMethods->xSync(Real(f), flags);
+    },
+    [](sqlite3_file* f, sqlite3_int64* size) {
+        return Real(f)->pMethods->xFileSize(Real(f), size);
+    },
+    [](sqlite3_file* f, int lock) {
+        return Real(f)->pMethods->xLock(Real(f), lock);
+    },
+    [](sqlite3_file* f, int lock) {
+        return Real(f)->pMethods->xUnlock(Real(f), lock);
+    },
+    [](sqlite3_file* f, int* reserved) {
+        return Real(f)->pMethods->xCheckReservedLock(Real(f), reserved);
+    },
+    [](sqlite3_file* f, int op, void* arg) {
+        return Real(f)->pMethods->xFileControl(Real(f), op, arg);
+    },
+    [](sqlite3_file* f) {
+        return Real(f)->pMethods->xSectorSize(Real(f));
+    },
+    [](sqlite3_file* f) {
+        return Real(f)->pMethods->xDeviceCharacteristics(Real(f));
+    },
+    [](sqlite3_file* f, int page, int size, int extend, void volatile** out) {
+        return Real(f)->pMethods->xShmMap(Real(f), page, size, extend, out);
+    },
+    [](sqlite3_file* f, int offset, int count, int flags) {
+        return Real(f)->pMethods->xShmLock(Real(f), offset, count, flags);
+    },
+    [](sqlite3_file* f) {
+        Real(f)->pMethods->xShmBarrier(Real(f));
+    },
+    [](sqlite3_file* f, int deleteFlag) {
+        return Real(f)->pMethods->xShmUnmap(Real(f), deleteFlag);
+    },
+    // Memory-mapped pages would bypass decryption
+    [](sqlite3_file* f, sqlite3_int64 offset, int amount, void** out) {
+        if (reinterpret_cast<File*>(f)->keyPath) {
+            *out = nullptr;
+            return SQLITE_OK;
+        }
+        return Real(f)->pMethods->xFetch(Real(f), offset, amount, out);
+    },
+    [](sqlite3_file* f, sqlite3_int64 offset, void* page) {
+        if (reinterpret_cast<File*>(f)->keyPath) {
+            return SQLITE_OK;
+        }
+        return Real(f)->pMethods->xUnfetch(Real(f), offset, page);
+    },
+};
+
+#endif // ALARM_CORE_H
@@ -15,12 +15,56 @@
 #include <wx/statbmp.h>
 #include <wx/slider.h>
 #include <wx/graphics.h>
+#include <wx/dcbuffer.h>
+#include <wx/stopwatch.h>
+#include <wx/thread.h>
+#include <wx/cmdline.h>
+#include <wx/numdlg.h>
+#include <wx/progdlg.h>
+#include <wx/notifmsg.h>
+#include <wx/srchctrl.h>
+#include <wx/dir.h>
 #include <sqlite3.h>
 #include <vector>
 #include <map>
+#include <set>
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <ctime>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <atomic>
+#include <tuple>
+#include <cstddef>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/aes.h>
+#ifdef __LINUX__
+#include <sys/timerfd.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "alarm_core.h"
+
+// Enable with WXTRACE=timing to log how late each alarm fired
+#define TRACE_TIMING wxT("timing")
 
 using namespace std;
 
@@ -33,6 +77,16 @@ enum {
     ID_CHANGE_PASSWORD,
     ID_SOUND_SETTINGS,
     ID_VOLUME_SLIDER,
+    ID_CLOCK_TIMER,
+    ID_WHEEL_TIMER,
+    ID_START_COUNTDOWN,
+    ID_CANCEL_TIMERS,
+    ID_MEASURE_JITTER,
+    ID_IMPORT_ALARMS,
+    ID_EXPORT_ALARMS,
+    ID_WEEK_VIEW,
+    ID_SHOW_SECONDS,
+    ID_SNOOZE,
     ID_TIME_FORMAT = wxID_HIGHEST + 100
 };
 
@@ -43,9 +97,12 @@ class AlarmTaskBarIcon;
 class AlarmApp : public wxApp {
 public:
     virtual bool OnInit();
+    virtual void OnInitCmdLine(wxCmdLineParser& parser);
+    virtual bool OnCmdLineParsed(wxCmdLineParser& parser);
 
 private:
     wxLocale m_locale;
+    bool runBenchmark = false;
 };
 
 class SoundSettingsDialog : public wxDialog {
@@ -157,6 +214,3731 @@ private:
     }
 };
 
+// Untranslated name for a weekday mask, as the alarm list shows it
+static std::string DayMaskName(unsigned mask) {
+    if (mask == kEveryDayMask) {
+        return "Every Day";
+    }
+    std::string name;
+    for (int i = 0; i < 7; i++) {
+        if (mask & (1u << i)) {
+            name += (name.empty() ? "" : ", ") + std::string(kDayNames[i]);
+        }
+    }
+    return name;
+}
+
+// Orders day masks the way the day choice lists them: "Every Day", then by
+// the first day set in a Monday-first week. Sorting calls it for every
+// comparison, so the keys are worked out once.
+static int DaySortKey(unsigned mask) {
+    static const std::vector<int> keys = [] {
+        std::vector<int> keys(kEveryDayMask + 1);
+        for (unsigned m = 0; m <= kEveryDayMask; m++) {
+            int first = 8;
+            for (int i = 7; i >= 1; i--) {
+                if (m & (1u << (i % 7))) {
+                    first = i;
+                }
+            }
+            keys[m] = m == kEveryDayMask ? 0 : first * 128 + (int)m;
+        }
+        return keys;
+    }();
+    return keys[mask & kEveryDayMask];
+}
+
+static std::string FormatMinuteOfDay(int minuteOfDay) {
+    char buffer[6];
+    snprintf(buffer, sizeof(buffer), "%02d:%02d", minuteOfDay / 60, minuteOfDay % 60);
+    return std::string(buffer);
+}
+
+// Inverse of DayMaskName; also accepts translated names, which older builds
+// stored, and ';' between days. 0 if any name is unknown.
+static unsigned DayMaskFromName(const std::string& names) {
+    unsigned mask = 0;
+    for (size_t from = 0; from <= names.size(); ) {
+        size_t end = names.find_first_of(",;", from);
+        if (end == std::string::npos) end = names.size();
+        size_t first = names.find_first_not_of(' ', from);
+        size_t last = names.find_last_not_of(' ', end - 1);
+        std::string day = first < end ? names.substr(first, last - first + 1) : "";
+        from = end + 1;
+
+        unsigned bit = 0;
+        if (day == "Every Day" || day == wxGetTranslation("Every Day").utf8_str().data()) {
+            bit = kEveryDayMask;
+        }
+        for (int i = 0; i < 7 && bit == 0; i++) {
+            if (day == kDayNames[i] || day == wxGetTranslation(kDayNames[i]).utf8_str().data()) {
+                bit = 1u << i;
+            }
+        }
+        if (bit == 0) {
+            return 0;
+        }
+        mask |= bit;
+    }
+    return mask;
+}
+
+// Minute-of-week index over all alarms: a 7x1440 occupancy bitmap plus a
+// struct-of-arrays table with one entry per (alarm, weekday), chained per
+// slot. Matching a minute walks only that slot's chain and never allocates.
+class AlarmIndex {
+public:
+    static const int kMinutesPerDay = 1440;
+    static const int kSlots = 7 * kMinutesPerDay;
+
+    AlarmIndex() {
+        Clear();
+    }
+
+    void Clear() {
+        std::fill(std::begin(occupied), std::end(occupied), 0);
+        std::fill(std::begin(slotHead), std::end(slotHead), -1);
+        rowOfId.clear();
+        rowId.clear();
+        rowMinute.clear();
+        rowDays.clear();
+        rowFirstEntry.clear();
+        entryRow.clear();
+        entrySlot.clear();
+        entryNext.clear();
+        entryPrev.clear();
+        entrySibling.clear();
+        freeRows.clear();
+        freeEntries.clear();
+    }
+
+    void Reserve(size_t alarms) {
+        rowOfId.reserve(alarms);
+        rowId.reserve(alarms);
+        rowMinute.reserve(alarms);
+        rowDays.reserve(alarms);
+        rowFirstEntry.reserve(alarms);
+    }
+
+    size_t Size() const {
+        return rowOfId.size();
+    }
+
+    void Add(int id, int minuteOfDay, unsigned dayMask) {
+        Remove(id);
+        dayMask &= kEveryDayMask;
+        if (dayMask == 0 || minuteOfDay < 0 || minuteOfDay >= kMinutesPerDay) {
+            return;
+        }
+
+        int row = AllocRow();
+        rowId[row] = id;
+        rowMinute[row] = (uint16_t)minuteOfDay;
+        rowDays[row] = (uint8_t)dayMask;
+        rowFirstEntry[row] = -1;
+        rowOfId[id] = row;
+
+        for (int day = 0; day < 7; day++) {
+            if (dayMask & (1u << day)) {
+                int entry = AllocEntry();
+                int slot = day * kMinutesPerDay + minuteOfDay;
+                entryRow[entry] = row;
+                entrySlot[entry] = (uint16_t)slot;
+                entrySibling[entry] = rowFirstEntry[row];
+                rowFirstEntry[row] = entry;
+                Link(entry, slot);
+            }
+        }
+    }
+
+    void Remove(int id) {
+        auto it = rowOfId.find(id);
+        if (it == rowOfId.end()) {
+            return;
+        }
+        int row = it->second;
+        for (int entry = rowFirstEntry[row]; entry != -1; ) {
+            int sibling = entrySibling[entry];
+            Unlink(entry);
+            freeEntries.push_back(entry);
+            entry = sibling;
+        }
+        rowOfId.erase(it);
+        freeRows.push_back(row);
+    }
+
+    bool IsOccupied(int slot) const {
+        return (occupied[slot >> 6] >> (slot & 63)) & 1;
+    }
+
+    // First occupied slot at or after `from`, wrapping around the week; -1 if empty
+    int NextOccupied(int from) const {
+        const int words = kSlots / 64 + 1;
+        int word = from >> 6;
+        uint64_t bits = occupied[word] & (~0ULL << (from & 63));
+        for (int scanned = 0; scanned <= words; scanned++) {
+            if (bits) {
+                return word * 64 + __builtin_ctzll(bits);
+            }
+            word = (word + 1) % words;
+            bits = occupied[word];
+        }
+        return -1;
+    }
+
+    template <typename Fn>
+    void ForEachInSlot(int slot, Fn fn) const {
+        for (int entry = slotHead[slot]; entry != -1; entry = entryNext[entry]) {
+            fn(rowId[entryRow[entry]]);
+        }
+    }
+
+private:
+    int AllocRow() {
+        if (!freeRows.empty()) {
+            int row = freeRows.back();
+            freeRows.pop_back();
+            return row;
+        }
+        rowId.push_back(0);
+        rowMinute.push_back(0);
+        rowDays.push_back(0);
+        rowFirstEntry.push_back(-1);
+        return (int)rowId.size() - 1;
+    }
+
+    int AllocEntry() {
+        if (!freeEntries.empty()) {
+            int entry = freeEntries.back();
+            freeEntries.pop_back();
+            return entry;
+        }
+        entryRow.push_back(-1);
+        entrySlot.push_back(0);
+        entryNext.push_back(-1);
+        entryPrev.push_back(-1);
+        entrySibling.push_back(-1);
+        return (int)entryRow.size() - 1;
+    }
+
+    void Link(int entry, int slot) {
+        entryPrev[entry] = -1;
+        entryNext[entry] = slotHead[slot];
+        if (slotHead[slot] != -1) {
+            entryPrev[slotHead[slot]] = entry;
+        }
+        slotHead[slot] = entry;
+        occupied[slot >> 6] |= 1ULL << (slot & 63);
+    }
+
+    void Unlink(int entry) {
+        int slot = entrySlot[entry];
+        if (entryPrev[entry] != -1) {
+            entryNext[entryPrev[entry]] = entryNext[entry];
+        } else {
+            slotHead[slot] = entryNext[entry];
+        }
+        if (entryNext[entry] != -1) {
+            entryPrev[entryNext[entry]] = entryPrev[entry];
+        }
+        if (slotHead[slot] == -1) {
+            occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+        }
+    }
+
+    uint64_t occupied[kSlots / 64 + 1];
+    int slotHead[kSlots];
+    std::unordered_map<int, int> rowOfId;
+
+    // Alarm rows
+    std::vector<int> rowId;
+    std::vector<uint16_t> rowMinute;
+    std::vector<uint8_t> rowDays;
+    std::vector<int> rowFirstEntry;
+
+    // Slot entries, doubly linked per slot and singly linked per row
+    std::vector<int> entryRow;
+    std::vector<uint16_t> entrySlot;
+    std::vector<int> entryNext;
+    std::vector<int> entryPrev;
+    std::vector<int> entrySibling;
+
+    std::vector<int> freeRows;
+    std::vector<int> freeEntries;
+};
+
+// Turns alarms into deadlines. Plain weekly alarms live in the minute-of-week
+// index; richer recurrence rules keep their next occurrence in a min-heap.
+// The frame arms one timer for whichever comes first.
+//
+// Progress is tracked in local wall-clock minutes, so every minute of the
+// wall clock is checked exactly once even when DST repeats or skips some.
+class AlarmScheduler {
+public:
+    void Clear(time_t now) {
+        index.Clear();
+        rules.clear();
+        queue = Queue();
+        zone.Refresh(now);
+        // Start from the current minute so an alarm due right now still fires
+        cursor = zone.LocalMinute(now);
+    }
+
+    void Add(int id, int minuteOfDay, const RecurrenceRule& rule) {
+        Remove(id);
+        if (rule.IsPlainWeekly()) {
+            index.Add(id, minuteOfDay, rule.weekdays);
+            return;
+        }
+        Rule& entry = rules[id];
+        entry.rule = rule;
+        entry.minuteOfDay = minuteOfDay;
+        entry.generation = ++lastGeneration;
+        Push(id, entry, zone.ToUtc(cursor));
+    }
+
+    // Heap entries of removed rules are dropped lazily when they surface
+    void Remove(int id) {
+        index.Remove(id);
+        rules.erase(id);
+    }
+
+    const AlarmIndex& Index() const {
+        return index;
+    }
+
+    const LocalTimeZone& Zone() const {
+        return zone;
+    }
+
+    // Earliest pending deadline, or 0 when nothing is scheduled
+    time_t NextDeadline() {
+        int64_t minute;
+        int slot;
+        time_t weekly = NextWeeklyDeadline(&minute, &slot);
+        time_t other = NextRuleDeadline();
+        return weekly == 0 || (other != 0 && other < weekly) ? other : weekly;
+    }
+
+    // After a clock step backwards, resume checking from the new time rather
+    // than waiting for the old one to come round again
+    void ClockChanged(time_t now) {
+        zone.Advance(now);
+        cursor = std::min(cursor, zone.LocalMinute(now) + 1);
+        RequeueRules();
+    }
+
+    // Wall-clock minutes mean something else in the new zone, so start over
+    // from the current one
+    void TimeZoneChanged(time_t now) {
+        zone.Refresh(now);
+        cursor = zone.LocalMinute(now) + 1;
+        RequeueRules();
+    }
+
+    // Hands every alarm due at or before `now` to onFire(id, scheduledAt)
+    template <typename Fn>
+    void PopDue(time_t now, Fn onFire) {
+        zone.Advance(now);
+        int64_t nowMinute = zone.LocalMinute(now);
+        // Missed minutes (e.g. after a suspend) are replayed, but never more than a week
+        cursor = std::max(cursor, nowMinute - 7 * AlarmIndex::kMinutesPerDay);
+        for (;;) {
+            int64_t minute;
+            int slot;
+            time_t weekly = NextWeeklyDeadline(&minute, &slot);
+            time_t other = NextRuleDeadline();
+            if (other != 0 && other <= now && (weekly == 0 || other < weekly)) {
+                Entry entry = queue.top();
+                queue.pop();
+                onFire(entry.id, entry.when);
+                Push(entry.id, rules[entry.id], entry.when + 60);
+            } else if (weekly != 0 && weekly <= now) {
+                index.ForEachInSlot(slot, [&](int id) {
+                    onFire(id, weekly);
+                });
+                cursor = minute + 1;
+            } else {
+                break;
+            }
+        }
+        cursor = std::max(cursor, nowMinute + 1);
+    }
+
+    // First instant at or after notBefore at which the rule fires, or 0
+    time_t NextFireTime(const RecurrenceRule& rule, int minuteOfDay, time_t notBefore) const {
+        int32_t day = rule.NextDay(zone.LocalDay(notBefore));
+        if (day == RecurrenceRule::kNever) {
+            return 0;
+        }
+        time_t when = zone.ToUtc((int64_t)day * AlarmIndex::kMinutesPerDay + minuteOfDay);
+        if (when < notBefore) {
+            day = rule.NextDay(day + 1);
+            if (day == RecurrenceRule::kNever) {
+                return 0;
+            }
+            when = zone.ToUtc((int64_t)day * AlarmIndex::kMinutesPerDay + minuteOfDay);
+        }
+        return when;
+    }
+
+private:
+    struct Rule {
+        RecurrenceRule rule;
+        int minuteOfDay = 0;
+        unsigned generation = 0;
+    };
+
+    struct Entry {
+        time_t when;
+        int id;
+        unsigned generation;
+        bool operator>(const Entry& other) const { return when > other.when; }
+    };
+
+    typedef std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> Queue;
+
+    void Push(int id, const Rule& entry, time_t notBefore) {
+        time_t when = NextFireTime(entry.rule, entry.minuteOfDay, notBefore);
+        if (when != 0) {
+            queue.push({when, id, entry.generation});
+        }
+    }
+
+    void RequeueRules() {
+        queue = Queue();
+        time_t notBefore = zone.ToUtc(cursor);
+        for (auto& entry : rules) {
+            entry.second.generation = ++lastGeneration;
+            Push(entry.first, entry.second, notBefore);
+        }
+    }
+
+    time_t NextRuleDeadline() {
+        while (!queue.empty()) {
+            auto it = rules.find(queue.top().id);
+            if (it != rules.end() && it->second.generation == queue.top().generation) {
+                return queue.top().when;
+            }
+            queue.pop();
+        }
+        return 0;
+    }
+
+    // Next occupied index slot at or after the cursor, as both the local
+    // minute it falls on and the instant that minute begins
+    time_t NextWeeklyDeadline(int64_t* minute, int* slot) const {
+        const int kMinutesPerDay = AlarmIndex::kMinutesPerDay;
+        int32_t day = (int32_t)FloorDiv(cursor, kMinutesPerDay);
+        int from = WeekdayFromDays(day) * kMinutesPerDay + (int)(cursor - (int64_t)day * kMinutesPerDay);
+        *slot = index.NextOccupied(from);
+        if (*slot == -1) {
+            return 0;
+        }
+        *minute = cursor + (*slot - from + AlarmIndex::kSlots) % AlarmIndex::kSlots;
+        return zone.ToUtc(*minute);
+    }
+
+    AlarmIndex index;
+    LocalTimeZone zone;
+    std::unordered_map<int, Rule> rules;
+    Queue queue;
+    unsigned lastGeneration = 0;
+    int64_t cursor = 0; // First local minute not yet checked
+};
+
+// Append-only record of every alarm occurrence that has fired, keyed by
+// alarm id and scheduled instant, so an occurrence fires exactly once even
+// if the app is restarted or crashes within its minute. Each fire costs one
+// 16-byte append; the file is rewritten without stale entries when it grows.
+class FireLedger {
+public:
+    ~FireLedger() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool Open(const std::string& ledgerPath, time_t now) {
+        path = ledgerPath;
+        fired.clear();
+        appended = 0;
+
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in) {
+            Entry record;
+            // A torn or damaged tail record is ignored
+            while (fread(&record, sizeof(record), 1, in) == 1 && record.check == Check(record)) {
+                if (record.when >= Horizon(now)) {
+                    fired.insert({record.id, record.when});
+                }
+                appended++;
+            }
+            fclose(in);
+        }
+
+        // Start every session from a clean file
+        return Compact(now);
+    }
+
+    // Returns false if this occurrence has already fired
+    bool Record(int id, time_t scheduledAt) {
+        if (!fired.insert({id, (int64_t)scheduledAt}).second) {
+            return false;
+        }
+        if (file) {
+            Entry record = {(int64_t)scheduledAt, (int32_t)id, 0};
+            record.check = Check(record);
+            fwrite(&record, sizeof(record), 1, file);
+            fflush(file);
+#ifdef __LINUX__
+            fdatasync(fileno(file));
+#endif
+            appended++;
+            if (appended > 2 * fired.size() + 64) {
+                Compact(scheduledAt);
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Entry {
+        int64_t when;
+        int32_t id;
+        uint32_t check;
+    };
+
+    static uint32_t Check(const Entry& record) {
+        return 0x4C45444Eu ^ (uint32_t)record.id ^ (uint32_t)record.when ^ (uint32_t)(record.when >> 32);
+    }
+
+    // Occurrences older than the scheduler's one week replay window can never fire again
+    static int64_t Horizon(time_t now) {
+        return (int64_t)now - 8 * 24 * 60 * 60;
+    }
+
+    // Rewrites the live entries to a fresh file and swaps it in
+    bool Compact(time_t now) {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+        for (auto it = fired.begin(); it != fired.end(); ) {
+            it = it->second < Horizon(now) ? fired.erase(it) : std::next(it);
+        }
+
+        std::string tempPath = path + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if (!out) {
+            file = fopen(path.c_str(), "ab");
+            return file != nullptr;
+        }
+        for (const auto& key : fired) {
+            Entry record = {key.second, (int32_t)key.first, 0};
+            record.check = Check(record);
+            fwrite(&record, sizeof(record), 1, out);
+        }
+        bool ok = fflush(out) == 0;
+#ifdef __LINUX__
+        ok = ok && fsync(fileno(out)) == 0;
+#endif
+        ok = fclose(out) == 0 && ok;
+#ifdef _WIN32
+        remove(path.c_str());
+#endif
+        if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            remove(tempPath.c_str());
+        } else {
+            appended = fired.size();
+        }
+        file = fopen(path.c_str(), "ab");
+        return file != nullptr;
+    }
+
+    std::string path;
+    FILE* file = nullptr;
+    std::set<std::pair<int, int64_t>> fired;
+    size_t appended = 0; // Records in the file, live or not
+};
+
+#ifdef __LINUX__
+// One-shot timerfd on CLOCK_REALTIME armed for an absolute wall-clock
+// instant. The kernel cancels it whenever the clock is set (NTP step, manual
+// change, resume from suspend), so those are reported instead of slept through.
+class WallClockTimer {
+public:
+    WallClockTimer() : fd(timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) {}
+
+    ~WallClockTimer() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool IsOk() const {
+        return fd != -1;
+    }
+
+    int Fd() const {
+        return fd;
+    }
+
+    void Arm(int64_t deadlineMs) {
+        itimerspec spec = {};
+        spec.it_value.tv_sec = (time_t)(deadlineMs / 1000);
+        spec.it_value.tv_nsec = (long)(deadlineMs % 1000) * 1000000;
+        timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr);
+    }
+
+    void Disarm() {
+        itimerspec spec = {};
+        timerfd_settime(fd, 0, &spec, nullptr);
+    }
+
+    // Call once the fd polls readable; true if the clock was set meanwhile
+    bool ClockChanged() {
+        uint64_t expirations;
+        return read(fd, &expirations, sizeof(expirations)) == -1 && errno == ECANCELED;
+    }
+
+private:
+    int fd;
+};
+
+// Watches /etc/localtime being replaced (e.g. by timedatectl set-timezone)
+// so cached time zone data can be rebuilt.
+class TimeZoneWatch {
+public:
+    TimeZoneWatch() : fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+        if (fd != -1 && inotify_add_watch(fd, "/etc", IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    ~TimeZoneWatch() {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    bool IsOk() const {
+        return fd != -1;
+    }
+
+    int Fd() const {
+        return fd;
+    }
+
+    // Call once the fd polls readable
+    bool Changed() {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length; ) {
+                const inotify_event* event = (const inotify_event*)p;
+                if (event->len && strcmp(event->name, "localtime") == 0) {
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+
+private:
+    int fd;
+};
+#endif
+
+// An alarm as the scheduler sees it
+struct AlarmSpec {
+    int id;
+    int minuteOfDay;
+    RecurrenceRule rule;
+};
+
+// One occurrence the scheduler thread found due, in epoch milliseconds
+struct AlarmFire {
+    int id;
+    double scheduledMs;
+    double firedMs; // When the scheduler thread woke for it
+};
+
+// Payload: std::vector<AlarmFire>
+wxDEFINE_EVENT(EVT_ALARMS_DUE, wxThreadEvent);
+wxDEFINE_EVENT(EVT_TIME_ZONE_CHANGED, wxThreadEvent);
+
+// Evaluates alarms on a thread of its own, so a modal dialog or a slow paint
+// on the GUI thread can never hold up an alarm. The thread owns the
+// scheduler, the fire ledger and its wakeup sources; the GUI only queues
+// commands to it and is told about due alarms through wxQueueEvent.
+class SchedulerThread : public wxThread {
+public:
+    // Id reported for jitter probe fires
+    static const int kProbeId = -1;
+
+    SchedulerThread(wxEvtHandler* sink, const std::string& ledgerPath)
+        : wxThread(wxTHREAD_JOINABLE), sink(sink), ledgerPath(ledgerPath), wakeup(commandsLock) {
+#ifdef __LINUX__
+        commandFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+
+    ~SchedulerThread() {
+#ifdef __LINUX__
+        if (commandFd != -1) {
+            close(commandFd);
+        }
+#endif
+    }
+
+    // The commands below may be called from any thread
+
+    void ReplaceAlarms(std::vector<AlarmSpec> alarms) {
+        auto batch = std::make_shared<std::vector<AlarmSpec>>(std::move(alarms));
+        Post([this, batch]() {
+            scheduler.Clear(time(0));
+            for (const AlarmSpec& alarm : *batch) {
+                scheduler.Add(alarm.id, alarm.minuteOfDay, alarm.rule);
+            }
+        });
+    }
+
+    void AddAlarm(const AlarmSpec& alarm) {
+        Post([this, alarm]() {
+            scheduler.Add(alarm.id, alarm.minuteOfDay, alarm.rule);
+        });
+    }
+
+    void RemoveAlarm(int id) {
+        Post([this, id]() {
+            scheduler.Remove(id);
+        });
+    }
+
+    // Reports `count` probe fires, one on each of the next whole seconds
+    void StartJitterProbe(int count) {
+        Post([this, count]() {
+            probesLeft = count;
+            probeAtMs = (int64_t)(NowMillis() / 1000 + 1) * 1000;
+        });
+    }
+
+    // Stops the thread and waits for it to exit
+    void Shutdown() {
+        Post([this]() {
+            stopping = true;
+        });
+        Wait();
+    }
+
+protected:
+    ExitCode Entry() override {
+        ledger.Open(ledgerPath, time(0));
+        scheduler.Clear(time(0));
+        while (!stopping) {
+            RunCommands();
+            FireDue();
+            if (!stopping) {
+                WaitForWork();
+            }
+        }
+        return 0;
+    }
+
+private:
+    static double NowMillis() {
+        return wxGetUTCTimeUSec().ToDouble() / 1000.0;
+    }
+
+    void Post(std::function<void()> command) {
+        wxMutexLocker lock(commandsLock);
+        commands.push_back(std::move(command));
+#ifdef __LINUX__
+        if (commandFd != -1) {
+            uint64_t one = 1;
+            if (write(commandFd, &one, sizeof(one)) == sizeof(one)) {
+                return;
+            }
+        }
+#endif
+        wakeup.Signal();
+    }
+
+    void RunCommands() {
+        std::vector<std::function<void()>> pending;
+        {
+            wxMutexLocker lock(commandsLock);
+            pending.swap(commands);
+        }
+        for (auto& command : pending) {
+            command();
+        }
+    }
+
+    void FireDue() {
+        std::vector<AlarmFire> fires;
+        scheduler.PopDue(time(0), [&](int id, time_t scheduledAt) {
+            // Already fired before a restart, or the clock was set back over it
+            if (ledger.Record(id, scheduledAt)) {
+                fires.push_back({id, scheduledAt * 1000.0, NowMillis()});
+            }
+        });
+        if (probesLeft > 0 && NowMillis() >= probeAtMs) {
+            fires.push_back({kProbeId, (double)probeAtMs, NowMillis()});
+            probesLeft--;
+            probeAtMs += 1000;
+        }
+
+        if (!fires.empty()) {
+            wxThreadEvent* event = new wxThreadEvent(EVT_ALARMS_DUE);
+            event->SetPayload(fires);
+            wxQueueEvent(sink, event);
+        }
+    }
+
+    // Sleeps until the next deadline, a queued command or a clock change
+    void WaitForWork() {
+        int64_t deadlineMs = (int64_t)scheduler.NextDeadline() * 1000;
+        if (probesLeft > 0 && (deadlineMs == 0 || probeAtMs < deadlineMs)) {
+            deadlineMs = probeAtMs;
+        }
+
+#ifdef __LINUX__
+        if (commandFd != -1 && wallClock.IsOk()) {
+            if (deadlineMs != 0) {
+                wallClock.Arm(deadlineMs);
+            } else {
+                wallClock.Disarm();
+            }
+            pollfd fds[3] = {
+                {commandFd, POLLIN, 0},
+                {wallClock.Fd(), POLLIN, 0},
+                {zoneWatch.Fd(), POLLIN, 0},
+            };
+            if (poll(fds, zoneWatch.IsOk() ? 3 : 2, -1) <= 0) {
+                return;
+            }
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                read(commandFd, &count, sizeof(count));
+            }
+            if ((fds[1].revents & POLLIN) && wallClock.ClockChanged()) {
+                wxLogTrace(TRACE_TIMING, "Wall clock was set, rescheduling");
+                scheduler.ClockChanged(time(0));
+            }
+            if ((fds[2].revents & POLLIN) && zoneWatch.Changed()) {
+                wxLogTrace(TRACE_TIMING, "System time zone changed, rescheduling");
+                scheduler.TimeZoneChanged(time(0));
+                wxQueueEvent(sink, new wxThreadEvent(EVT_TIME_ZONE_CHANGED));
+            }
+            return;
+        }
+#endif
+        // Cap the sleep so a wall-clock change is picked up within the hour
+        const int64_t maxSleepMs = 60 * 60 * 1000;
+        int64_t delayMs = deadlineMs == 0 ? maxSleepMs : deadlineMs - (int64_t)NowMillis();
+        wxMutexLocker lock(commandsLock);
+        if (commands.empty() && delayMs > 0) {
+            wakeup.WaitTimeout((unsigned long)std::min(delayMs, maxSleepMs));
+        }
+    }
+
+    wxEvtHandler* sink;
+    std::string ledgerPath;
+
+    // Touched only by the scheduler thread
+    AlarmScheduler scheduler;
+    FireLedger ledger;
+    bool stopping = false;
+    int probesLeft = 0;
+    int64_t probeAtMs = 0;
+#ifdef __LINUX__
+    WallClockTimer wallClock;
+    TimeZoneWatch zoneWatch;
+#endif
+
+    // Guarded by commandsLock
+    wxMutex commandsLock;
+    wxCondition wakeup;
+    std::vector<std::function<void()>> commands;
+#ifdef __LINUX__
+    int commandFd = -1;
+#endif
+};
+
+// The random key alarms.db is encrypted with. It is kept next to the
+// database, wrapped with AES-256-GCM under a key derived from the app
+// password. While the database is moved to a new key the file holds the
+// key it is replacing as well, so a rotation cut short still opens.
+class DatabaseKey {
+public:
+    ~DatabaseKey() {
+        OPENSSL_cleanse(key, sizeof(key));
+        OPENSSL_cleanse(previous, sizeof(previous));
+    }
+
+    bool Generate() {
+        return RAND_bytes(key, sizeof(key)) == 1;
+    }
+
+    // Switches to a fresh key, keeping the current one as Previous()
+    bool Rotate() {
+        memcpy(previous, key, sizeof(key));
+        rotating = true;
+        return Generate();
+    }
+
+    void FinishRotation() {
+        OPENSSL_cleanse(previous, sizeof(previous));
+        rotating = false;
+    }
+
+    // False if the file is missing or damaged, or `password` is wrong
+    bool Load(const std::string& path, const std::string& password) {
+        KeyFile stored;
+        FILE* in = fopen(path.c_str(), "rb");
+        if (!in) {
+            return false;
+        }
+        // One key, with the tag where the second would be, or two
+        size_t size = fread(&stored, 1, sizeof(stored), in);
+        int keys = size == sizeof(stored) ? 2 : 1;
+        if (keys == 1) {
+            memcpy(stored.tag, stored.wrapped + kKeySize, sizeof(stored.tag));
+        }
+        bool ok = (size == sizeof(stored) || size == sizeof(stored) - kKeySize) &&
+                  memcmp(stored.magic, kMagic, sizeof(stored.magic)) == 0;
+        fclose(in);
+
+        unsigned char wrappingKey[EncryptedVfs::kKeySize];
+        int length;
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        ok = ok && ctx && DeriveWrappingKey(password, stored, wrappingKey) &&
+             EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, wrappingKey, stored.iv) == 1 &&
+             EVP_DecryptUpdate(ctx, nullptr, &length, stored.magic, sizeof(stored.magic)) == 1 &&
+             EVP_DecryptUpdate(ctx, stored.wrapped, &length, stored.wrapped, keys * kKeySize) == 1 &&
+             EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, sizeof(stored.tag), stored.tag) == 1 &&
+             EVP_DecryptFinal_ex(ctx, stored.wrapped + length, &length) == 1;
+        EVP_CIPHER_CTX_free(ctx);
+        if (ok) {
+            memcpy(key, stored.wrapped, sizeof(key));
+            FinishRotation();
+            if (keys == 2) {
+                memcpy(previous, stored.wrapped + kKeySize, sizeof(previous));
+                rotating = true;
+            }
+        }
+        OPENSSL_cleanse(wrappingKey, sizeof(wrappingKey));
+        OPENSSL_cleanse(&stored, sizeof(stored));
+        return ok;
+    }
+
+    // Wraps the key, and the previous one while rotating, under `password`
+    // and swaps the new file in
+    bool Save(const std::string& path, const std::string& password) const {
+        KeyFile stored;
+        int keys = rotating ? 2 : 1;
+        memcpy(stored.magic, kMagic, sizeof(stored.magic));
+        stored.iterations = kIterations;
+        memcpy(stored.wrapped, key, sizeof(key));
+        memcpy(stored.wrapped + kKeySize, previous, sizeof(previous));
+
+        unsigned char wrappingKey[EncryptedVfs::kKeySize];
+        int length;
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        bool ok = ctx && RAND_bytes(stored.salt, sizeof(stored.salt)) == 1 &&
+                  RAND_bytes(stored.iv, sizeof(stored.iv)) == 1 &&
+                  DeriveWrappingKey(password, stored, wrappingKey) &&
+                  EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, wrappingKey, stored.iv) == 1 &&
+                  EVP_EncryptUpdate(ctx, nullptr, &length, stored.magic, sizeof(stored.magic)) == 1 &&
+                  EVP_EncryptUpdate(ctx, stored.wrapped, &length, stored.wrapped, keys * kKeySize) == 1 &&
+                  EVP_EncryptFinal_ex(ctx, stored.wrapped + length, &length) == 1 &&
+                  EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, sizeof(stored.tag), stored.tag) == 1;
+        EVP_CIPHER_CTX_free(ctx);
+        OPENSSL_cleanse(wrappingKey, sizeof(wrappingKey));
+        if (!ok) {
+            return false;
+        }
+        if (keys == 1) {
+            memcpy(stored.wrapped + kKeySize, stored.tag, sizeof(stored.tag));
+        }
+
+        std::string tempPath = path + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if (!out) {
+            return false;
+        }
+        ok = fwrite(&stored, sizeof(stored) - (2 - keys) * kKeySize, 1, out) == 1 && fflush(out) == 0;
+#ifdef __LINUX__
+        ok = ok && fsync(fileno(out)) == 0;
+#endif
+        ok = fclose(out) == 0 && ok;
+#ifdef _WIN32
+        remove(path.c_str());
+#endif
+        if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    const unsigned char* Data() const {
+        return key;
+    }
+
+    // The key being replaced, or null when not rotating
+    const unsigned char* Previous() const {
+        return rotating ? previous : nullptr;
+    }
+
+private:
+    static constexpr const char* kMagic = "ALRMKEY1";
+    static const uint32_t kIterations = 200000;
+    static const int kKeySize = EncryptedVfs::kKeySize;
+
+    struct KeyFile {
+        unsigned char magic[8];
+        unsigned char salt[16];
+        uint32_t iterations;
+        unsigned char iv[12];
+        unsigned char wrapped[2 * kKeySize]; // The key, then the previous one while rotating
+        unsigned char tag[16];
+    };
+
+    static bool DeriveWrappingKey(const std::string& password, const KeyFile& stored, unsigned char* out) {
+        return stored.iterations >= 1000 &&
+               PKCS5_PBKDF2_HMAC(password.data(), (int)password.size(), stored.salt, sizeof(stored.salt),
+                                 (int)stored.iterations, EVP_sha256(), EncryptedVfs::kKeySize, out) == 1;
+    }
+
+    unsigned char key[kKeySize] = {};
+    unsigned char previous[kKeySize] = {};
+    bool rotating = false;
+};
+
+// Salted scrypt hash of the app password, checked on unlock. The cost is
+// calibrated once, when the password is first set, so a check takes about
+// kTargetMs on that machine: N grows until scrypt would need more than
+// kMaxMemory, and any time still missing is made up with p, which OpenSSL
+// runs one lane after another. Deriving takes that long, so do it off the
+// GUI thread.
+struct PasswordHash {
+    static const int kTargetMs = 250;
+    static const uint64_t kMaxMemory = 64 << 20;
+
+    unsigned char salt[16] = {};
+    int logN = 14;
+    int r = 8;
+    int p = 1;
+    unsigned char hash[32] = {};
+
+    // Default parameters scaled to this machine; salt and hash unset
+    static PasswordHash Calibrate(int targetMs = kTargetMs) {
+        PasswordHash probe;
+        unsigned char out[sizeof(probe.hash)];
+        wxStopWatch watch;
+        if (!probe.Run("calibrate", out)) {
+            return probe;
+        }
+        double scale = targetMs / std::max(1.0, (double)watch.Time());
+        PasswordHash calibrated = probe;
+        while (scale >= 2 && calibrated.Table(calibrated.logN + 1) <= kMaxMemory) {
+            calibrated.logN++;
+            scale /= 2;
+        }
+        while (scale < 0.5 && calibrated.logN > 12) {
+            calibrated.logN--;
+            scale *= 2;
+        }
+        calibrated.p = std::min(64, std::max(1, (int)(scale + 0.5)));
+        return calibrated;
+    }
+
+    // A fresh salt and the hash of `password` under it
+    bool Derive(const std::string& password) {
+        return RAND_bytes(salt, sizeof(salt)) == 1 && Run(password, hash);
+    }
+
+    bool Verify(const std::string& password) const {
+        unsigned char candidate[sizeof(hash)];
+        bool ok = Run(password, candidate) && CRYPTO_memcmp(candidate, hash, sizeof(hash)) == 0;
+        OPENSSL_cleanse(candidate, sizeof(candidate));
+        return ok;
+    }
+
+private:
+    // scrypt's N-entry table, which is most of the memory it needs
+    uint64_t Table(int logN) const {
+        return 128ull * r << logN;
+    }
+
+    uint64_t Memory() const {
+        return Table(logN) + 128ull * r * (p + 2);
+    }
+
+    bool Run(const std::string& password, unsigned char* out) const {
+        // Parameters come from the database, so keep them to what Calibrate() picks
+        return logN > 0 && logN < 32 && r > 0 && r <= 32 && p > 0 && p <= 64 &&
+               Table(logN) <= kMaxMemory &&
+               EVP_PBE_scrypt(password.data(), password.size(), salt, sizeof(salt), 1ull << logN, r, p,
+                              Memory(), out, sizeof(hash)) == 1;
+    }
+};
+
+// One committed change to a row of the alarms table
+struct AlarmChange {
+    enum Kind { Inserted, Updated, Deleted };
+
+    Kind kind;
+    int id;
+    int minuteOfDay = 0;     // The row as it is now; unset for Deleted
+    unsigned dayMask = 0;
+    std::string recurrence;  // Empty when the alarm has none
+    std::string label;       // Empty when the alarm has none
+};
+
+// Data access for alarms.db. Each statement is compiled once per connection
+// and then reset and rebound for every use; values are always bound as
+// parameters, never spliced into the SQL text.
+class AlarmStore {
+public:
+    ~AlarmStore() {
+        Close();
+    }
+
+    // With a key, the database is kept encrypted through EncryptedVfs; an
+    // unencrypted file at `path` is converted first. `previousKey` is for a
+    // database whose key rotation was cut short.
+    bool Open(const char* path, const unsigned char* key = nullptr, const unsigned char* previousKey = nullptr) {
+        const char* vfs = nullptr;
+        if (key) {
+            if (!EncryptedVfs::Recover(path) || !EncryptExisting(path, key, &setAside) ||
+                !EncryptedVfs::SetKey(path, key, previousKey)) {
+                return false;
+            }
+            vfs = EncryptedVfs::Name();
+        }
+        if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs) != SQLITE_OK) {
+            return false;
+        }
+        if (key) {
+            // A new database gets room for the IV and tag at the end of every page
+            int reserve = EncryptedVfs::kReserve;
+            std::string pageSize = "PRAGMA page_size = " + std::to_string(EncryptedVfs::kPageSize) + ";";
+            sqlite3_exec(db, pageSize.c_str(), 0, 0, 0);
+            sqlite3_file_control(db, "main", SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+            // Sorts and temporary tables would otherwise spill to unencrypted files
+            sqlite3_exec(db, "PRAGMA temp_store = MEMORY;", 0, 0, 0);
+            // Fails if the file can't be decrypted
+            if (sqlite3_exec(db, "SELECT count(*) FROM sqlite_master;", 0, 0, 0) != SQLITE_OK) {
+                Close();
+                return false;
+            }
+        }
+        sqlite3_update_hook(db, OnUpdate, this);
+        sqlite3_commit_hook(db, OnCommit, this);
+        sqlite3_rollback_hook(db, OnRollback, this);
+        // WAL lets readers run alongside the writer; NORMAL only syncs at
+        // checkpoints, which WAL keeps consistent across crashes
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL;", 0, 0, 0);
+        sqlite3_exec(db, "PRAGMA synchronous = NORMAL;", 0, 0, 0);
+        sqlite3_busy_timeout(db, 2000);
+        return true;
+    }
+
+    void Close() {
+        rekeyer.reset();
+        labelSearch = nullptr;
+        for (auto& entry : statements) {
+            sqlite3_finalize(entry.second);
+        }
+        statements.clear();
+        if (db) {
+            sqlite3_close(db);
+            db = nullptr;
+        }
+        uncommitted.clear();
+        journal.clear();
+    }
+
+    sqlite3* Handle() const {
+        return db;
+    }
+
+    // Starts moving an encrypted database from `previousKey` to `key`, or
+    // picks up where a rotation to the same key left off. The pages are then
+    // re-encrypted a batch per StepKeyRotation(), so writes can go in
+    // between; connections opened elsewhere keep reading throughout.
+    bool BeginKeyRotation(const unsigned char* key, const unsigned char* previousKey, int threads = 0) {
+        const char* path = sqlite3_db_filename(db, "main");
+        unsigned char keyId[kKeyIdSize];
+        if (!path || !KeyId(key, keyId) || !EncryptedVfs::SetKey(path, key, previousKey)) {
+            return false;
+        }
+        rekeyer.reset(new EncryptedVfs::Rekeyer(db, threads));
+        rotationCursor = 0;
+        rotationWatch.Start();
+
+        // The cursor only counts for the key it was recorded under
+        sqlite3_stmt* stmt = Prepare("SELECT next_page FROM key_rotation WHERE id = 1 AND key_id = ?;");
+        if (stmt) {
+            sqlite3_bind_blob(stmt, 1, keyId, sizeof(keyId), SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                rotationCursor = sqlite3_column_int64(stmt, 0);
+            }
+            Release(stmt);
+        }
+        stmt = Prepare("INSERT OR REPLACE INTO key_rotation (id, key_id, next_page) VALUES (1, ?, ?);");
+        bool ok = stmt && rekeyer->IsOk();
+        if (ok) {
+            sqlite3_bind_blob(stmt, 1, keyId, sizeof(keyId), SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 2, rotationCursor);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            Release(stmt);
+        }
+        if (!ok) {
+            rekeyer.reset();
+        }
+        return ok;
+    }
+
+    // Re-encrypts the next batch of pages and records how far the rotation
+    // has got, so a restart resumes there. After the last one the WAL is
+    // checkpointed so no frame under the old key is left, and the old key
+    // is forgotten. A failure abandons the rotation with both keys kept.
+    bool StepKeyRotation() {
+        if (!rekeyer) {
+            return false;
+        }
+        if (rotationCursor < rekeyer->PageCount()) {
+            sqlite3_stmt* stmt = Prepare("UPDATE key_rotation SET next_page = ? WHERE id = 1;");
+            bool ok = stmt && rekeyer->Step(&rotationCursor);
+            if (ok) {
+                sqlite3_bind_int64(stmt, 1, rotationCursor);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                Release(stmt);
+            }
+            if (!ok) {
+                rekeyer.reset();
+            }
+            return ok;
+        }
+
+        int log, checkpointed;
+        int rc = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE, &log, &checkpointed);
+        if (rc == SQLITE_BUSY) {
+            return true; // A reader is still on old frames; try again next step
+        }
+        if (rc != SQLITE_OK || sqlite3_exec(db, "DELETE FROM key_rotation;", 0, 0, 0) != SQLITE_OK) {
+            rekeyer.reset();
+            return false;
+        }
+        wxLogTrace(TRACE_TIMING, "Rotated the key of %lld pages on %d threads in %ld ms",
+                   (long long)rotationCursor, rekeyer->Threads(), rotationWatch.Time());
+        EncryptedVfs::DropPreviousKey(sqlite3_db_filename(db, "main"));
+        rekeyer.reset();
+        return true;
+    }
+
+    bool RotatingKey() const {
+        return rekeyer != nullptr;
+    }
+
+    // How much of the rotation under way is done, 0 to 100
+    int KeyRotationPercent() {
+        int64_t pages = rekeyer ? rekeyer->PageCount() : 0;
+        return pages > 0 ? (int)std::min<int64_t>(100, rotationCursor * 100 / pages) : 100;
+    }
+
+    // Brings the schema up to date, running every pending migration in one
+    // transaction so a failure leaves the file exactly as it was
+    bool Upgrade() {
+        int version = 0;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, 0) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        if (version >= kSchemaVersion) {
+            return true;
+        }
+        if (sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+        bool movingTimes = version < 2;
+        for (; version < kSchemaVersion; version++) {
+            if (!kMigrations[version](db)) {
+                sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+                return false;
+            }
+        }
+        std::string setVersion = "PRAGMA user_version = " + std::to_string(kSchemaVersion) + ";";
+        if (sqlite3_exec(db, setVersion.c_str(), 0, 0, 0) != SQLITE_OK ||
+            sqlite3_exec(db, "COMMIT;", 0, 0, 0) != SQLITE_OK) {
+            sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+            return false;
+        }
+        if (movingTimes && sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM legacy_alarms;", -1, &stmt, 0) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                setAside = sqlite3_column_int(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+        }
+        return true;
+    }
+
+    // Alarms the Upgrade() just run, or the one Open() ran before
+    // encrypting the file, could not convert to integer times; their
+    // original text is in legacy_alarms
+    int SetAsideByUpgrade() const {
+        return setAside;
+    }
+
+    // Cached statement for `sql`, or nullptr if it does not compile. Hand it
+    // back with Release() before the next Prepare() of the same SQL.
+    sqlite3_stmt* Prepare(const std::string& sql) {
+        auto it = statements.find(sql);
+        if (it != statements.end()) {
+            return it->second;
+        }
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(stmt);
+            return nullptr;
+        }
+        statements.emplace(sql, stmt);
+        return stmt;
+    }
+
+    // Resets a statement so it holds no locks or bound values
+    static void Release(sqlite3_stmt* stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+    // Returns the new alarm's id, or 0 on failure
+    int InsertAlarm(int minuteOfDay, unsigned dayMask, const char* recurrence = nullptr,
+                    const std::string& label = std::string()) {
+        sqlite3_stmt* stmt = Prepare("INSERT INTO alarms (minute_of_day, day_mask, recurrence, label) "
+                                     "VALUES (?, ?, ?, ?);");
+        if (!stmt) {
+            return 0;
+        }
+        sqlite3_bind_int(stmt, 1, minuteOfDay);
+        sqlite3_bind_int(stmt, 2, (int)dayMask);
+        if (recurrence) {
+            sqlite3_bind_text(stmt, 3, recurrence, -1, SQLITE_STATIC);
+        }
+        sqlite3_bind_text(stmt, 4, label.data(), (int)label.size(), SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        Release(stmt);
+        return ok ? (int)sqlite3_last_insert_rowid(db) : 0;
+    }
+
+    bool DeleteAlarm(int id) {
+        sqlite3_stmt* stmt = Prepare("DELETE FROM alarms WHERE id = ?;");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, id);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        Release(stmt);
+        return ok;
+    }
+
+    // Starts a search of the labels for alarms matching every word of
+    // `words`, each as a prefix ("wor" finds "work"), ending any search
+    // before it. NextLabelMatches() then hands out the matches a few at a
+    // time, so a caller can show the first ones before the rest are found.
+    bool BeginLabelSearch(const std::string& words) {
+        EndLabelSearch();
+        std::string query = LabelQuery(words);
+        if (query.empty()) {
+            return false;
+        }
+        labelSearch = Prepare("SELECT rowid FROM alarm_labels WHERE alarm_labels MATCH ?;");
+        if (labelSearch) {
+            sqlite3_bind_text(labelSearch, 1, query.c_str(), -1, SQLITE_TRANSIENT);
+        }
+        return labelSearch != nullptr;
+    }
+
+    // Appends up to `max` more matching ids, in id order; false once there
+    // are no more
+    bool NextLabelMatches(std::vector<int>* ids, size_t max) {
+        for (; labelSearch && max > 0; max--) {
+            if (sqlite3_step(labelSearch) != SQLITE_ROW) {
+                EndLabelSearch();
+                break;
+            }
+            ids->push_back(sqlite3_column_int(labelSearch, 0));
+        }
+        return labelSearch != nullptr;
+    }
+
+    // Lets go of the search's statement, and with it the read transaction
+    // it holds open
+    void EndLabelSearch() {
+        if (labelSearch) {
+            Release(labelSearch);
+            labelSearch = nullptr;
+        }
+    }
+
+    // Whether alarm `id` is one BeginLabelSearch(words) would find
+    bool LabelMatches(int id, const std::string& words) {
+        std::string query = LabelQuery(words);
+        sqlite3_stmt* stmt = query.empty() ? nullptr
+                           : Prepare("SELECT 1 FROM alarm_labels WHERE alarm_labels MATCH ? AND rowid = ?;");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 2, id);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        Release(stmt);
+        return found;
+    }
+
+    // False if no password has been set yet
+    bool LoadPasswordHash(PasswordHash* password) {
+        sqlite3_stmt* stmt = Prepare("SELECT salt, log_n, r, p, hash FROM password WHERE id = 1;");
+        if (!stmt) {
+            return false;
+        }
+        bool ok = sqlite3_step(stmt) == SQLITE_ROW &&
+                  sqlite3_column_bytes(stmt, 0) == (int)sizeof(password->salt) &&
+                  sqlite3_column_bytes(stmt, 4) == (int)sizeof(password->hash);
+        if (ok) {
+            memcpy(password->salt, sqlite3_column_blob(stmt, 0), sizeof(password->salt));
+            password->logN = sqlite3_column_int(stmt, 1);
+            password->r = sqlite3_column_int(stmt, 2);
+            password->p = sqlite3_column_int(stmt, 3);
+            memcpy(password->hash, sqlite3_column_blob(stmt, 4), sizeof(password->hash));
+        }
+        Release(stmt);
+        return ok;
+    }
+
+    bool SavePasswordHash(const PasswordHash& password) {
+        sqlite3_stmt* stmt = Prepare("INSERT OR REPLACE INTO password (id, salt, log_n, r, p, hash) "
+                                     "VALUES (1, ?, ?, ?, ?, ?);");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_blob(stmt, 1, password.salt, sizeof(password.salt), SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, password.logN);
+        sqlite3_bind_int(stmt, 3, password.r);
+        sqlite3_bind_int(stmt, 4, password.p);
+        sqlite3_bind_blob(stmt, 5, password.hash, sizeof(password.hash), SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        Release(stmt);
+        return ok;
+    }
+
+    // Groups writes into one transaction, e.g. for bulk imports
+    bool Begin() {
+        return sqlite3_exec(db, "BEGIN IMMEDIATE;", 0, 0, 0) == SQLITE_OK;
+    }
+
+    bool Commit() {
+        return sqlite3_exec(db, "COMMIT;", 0, 0, 0) == SQLITE_OK;
+    }
+
+    void Rollback() {
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+    }
+
+    // fn(id, minuteOfDay, dayMask, recurrence, label) for every alarm;
+    // recurrence may be null, label is never
+    template <typename Fn>
+    void ForEachAlarm(Fn fn) {
+        sqlite3_stmt* stmt = Prepare("SELECT id, minute_of_day, day_mask, recurrence, label FROM alarms;");
+        if (!stmt) {
+            return;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* label = (const char*)sqlite3_column_text(stmt, 4);
+            fn(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), (unsigned)sqlite3_column_int(stmt, 2),
+               (const char*)sqlite3_column_text(stmt, 3), label ? label : "");
+        }
+        Release(stmt);
+    }
+
+    // fn(id, minuteOfDay, dayMask) for every alarm, ordered by time, day
+    // mask and id; the order the index stores them in
+    template <typename Fn>
+    void ForEachAlarmByTime(Fn fn) {
+        sqlite3_stmt* stmt = Prepare("SELECT id, minute_of_day, day_mask FROM alarms "
+                                     "ORDER BY minute_of_day, day_mask, id;");
+        if (!stmt) {
+            return;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            fn(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), (unsigned)sqlite3_column_int(stmt, 2));
+        }
+        Release(stmt);
+    }
+
+    // Row changes committed since the last drain, at most one per id
+    size_t PendingChanges() const {
+        return journal.size();
+    }
+
+    // fn(const AlarmChange&) for each alarm inserted, updated or deleted
+    // since the last call, by anyone using this connection. Rows are looked
+    // up again, so writes undone by ROLLBACK TO report the row as it is.
+    template <typename Fn>
+    void DrainChanges(Fn fn) {
+        // Collapse the journal to one net change per id
+        std::vector<std::pair<int, int>> changes; // (id, SQLITE_INSERT/UPDATE/DELETE or 0 for none)
+        std::unordered_map<int, size_t> position;
+        for (const auto& entry : journal) {
+            auto found = position.emplace(entry.second, changes.size());
+            if (found.second) {
+                changes.push_back({entry.second, entry.first});
+                continue;
+            }
+            int& kind = changes[found.first->second].second;
+            if (entry.first == SQLITE_DELETE) {
+                kind = kind == SQLITE_INSERT ? 0 : SQLITE_DELETE;
+            } else if (entry.first == SQLITE_INSERT) {
+                kind = kind == SQLITE_DELETE ? SQLITE_UPDATE : SQLITE_INSERT;
+            } else if (kind == 0) {
+                kind = SQLITE_UPDATE;
+            }
+        }
+        journal.clear();
+
+        sqlite3_stmt* stmt = Prepare("SELECT minute_of_day, day_mask, recurrence, label FROM alarms WHERE id = ?;");
+        for (const auto& entry : changes) {
+            if (entry.second == 0) {
+                continue;
+            }
+            AlarmChange change;
+            change.id = entry.first;
+            change.kind = entry.second == SQLITE_INSERT ? AlarmChange::Inserted : AlarmChange::Updated;
+            bool found = false;
+            if (stmt) {
+                sqlite3_bind_int(stmt, 1, change.id);
+                if (sqlite3_step(stmt) == SQLITE_ROW) {
+                    found = true;
+                    change.minuteOfDay = sqlite3_column_int(stmt, 0);
+                    change.dayMask = (unsigned)sqlite3_column_int(stmt, 1);
+                    const char* recurrence = (const char*)sqlite3_column_text(stmt, 2);
+                    change.recurrence = recurrence ? recurrence : "";
+                    const char* label = (const char*)sqlite3_column_text(stmt, 3);
+                    change.label = label ? label : "";
+                }
+                Release(stmt);
+            }
+            if (!found) {
+                change.kind = AlarmChange::Deleted;
+            }
+            fn(change);
+        }
+    }
+
+    void DiscardChanges() {
+        journal.clear();
+    }
+
+private:
+    typedef bool (*Migration)(sqlite3* db);
+    static const int kSchemaVersion = 6;
+    static const int kKeyIdSize = 16;
+    static const Migration kMigrations[kSchemaVersion];
+
+    // 1: the original text schema, plus the recurrence column
+    static bool CreateTextSchema(sqlite3* db) {
+        if (sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS alarms ("
+                             "id INTEGER PRIMARY KEY, "
+                             "time TEXT, "
+                             "day TEXT DEFAULT 'Every Day');", 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+        if (sqlite3_exec(db, "SELECT recurrence FROM alarms LIMIT 0;", 0, 0, 0) != SQLITE_OK) {
+            return sqlite3_exec(db, "ALTER TABLE alarms ADD COLUMN recurrence TEXT;", 0, 0, 0) == SQLITE_OK;
+        }
+        return true;
+    }
+
+    // 2: integer minute of day and weekday mask (bit 0 = Sunday) with an
+    // index that answers lookups and the time-ordered list on its own.
+    // Rows whose time or day names don't read (a translation from another
+    // locale, say) keep their original text in legacy_alarms rather than
+    // being dropped or given a mask that never rings.
+    static bool UseIntegerTimes(sqlite3* db) {
+        if (sqlite3_exec(db, "CREATE TABLE alarms_v2 ("
+                             "id INTEGER PRIMARY KEY, "
+                             "minute_of_day INTEGER NOT NULL, "
+                             "day_mask INTEGER NOT NULL DEFAULT 127, "
+                             "recurrence TEXT);", 0, 0, 0) != SQLITE_OK ||
+            sqlite3_exec(db, "CREATE TABLE legacy_alarms ("
+                             "id INTEGER PRIMARY KEY, "
+                             "legacy_time TEXT, "
+                             "legacy_day TEXT, "
+                             "recurrence TEXT);", 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+
+        sqlite3_stmt* select;
+        sqlite3_stmt* insert;
+        sqlite3_stmt* setAside;
+        if (sqlite3_prepare_v2(db, "SELECT id, time, day, recurrence FROM alarms;", -1, &select, 0) != SQLITE_OK) {
+            return false;
+        }
+        if (sqlite3_prepare_v2(db, "INSERT INTO alarms_v2 (id, minute_of_day, day_mask, recurrence) "
+                                   "VALUES (?, ?, ?, ?);", -1, &insert, 0) != SQLITE_OK) {
+            sqlite3_finalize(select);
+            return false;
+        }
+        if (sqlite3_prepare_v2(db, "INSERT INTO legacy_alarms (id, legacy_time, legacy_day, recurrence) "
+                                   "VALUES (?, ?, ?, ?);", -1, &setAside, 0) != SQLITE_OK) {
+            sqlite3_finalize(select);
+            sqlite3_finalize(insert);
+            return false;
+        }
+        bool ok = true;
+        while (ok && sqlite3_step(select) == SQLITE_ROW) {
+            const char* time = (const char*)sqlite3_column_text(select, 1);
+            const char* day = (const char*)sqlite3_column_text(select, 2);
+            int hour = -1, minute = -1;
+            unsigned dayMask = DayMaskFromName(day ? day : "Every Day");
+            if (!time || sscanf(time, "%d:%d", &hour, &minute) != 2 ||
+                hour < 0 || hour > 23 || minute < 0 || minute > 59 || dayMask == 0) {
+                sqlite3_bind_int(setAside, 1, sqlite3_column_int(select, 0));
+                sqlite3_bind_value(setAside, 2, sqlite3_column_value(select, 1));
+                sqlite3_bind_value(setAside, 3, sqlite3_column_value(select, 2));
+                sqlite3_bind_value(setAside, 4, sqlite3_column_value(select, 3));
+                ok = sqlite3_step(setAside) == SQLITE_DONE;
+                sqlite3_reset(setAside);
+                continue;
+            }
+            sqlite3_bind_int(insert, 1, sqlite3_column_int(select, 0));
+            sqlite3_bind_int(insert, 2, hour * 60 + minute);
+            sqlite3_bind_int(insert, 3, (int)dayMask);
+            sqlite3_bind_value(insert, 4, sqlite3_column_value(select, 3));
+            ok = sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_reset(insert);
+        }
+        sqlite3_finalize(select);
+        sqlite3_finalize(insert);
+        sqlite3_finalize(setAside);
+
+        return ok &&
+               sqlite3_exec(db, "DROP TABLE alarms;", 0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "ALTER TABLE alarms_v2 RENAME TO alarms;", 0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "CREATE INDEX alarms_by_minute ON alarms (minute_of_day, day_mask);",
+                            0, 0, 0) == SQLITE_OK;
+    }
+
+    // 3: the whole file is encrypted now; the per-alarm ciphertext copies
+    // (never decryptable, as their key wasn't kept) go
+    static bool DropSecureAlarms(sqlite3* db) {
+        return sqlite3_exec(db, "DROP TABLE IF EXISTS secure_alarms;", 0, 0, 0) == SQLITE_OK;
+    }
+
+    // 4: how far a key rotation has got, and which key it is rotating to
+    static bool CreateKeyRotation(sqlite3* db) {
+        return sqlite3_exec(db, "CREATE TABLE key_rotation ("
+                                "id INTEGER PRIMARY KEY CHECK (id = 1), "
+                                "key_id BLOB NOT NULL, "
+                                "next_page INTEGER NOT NULL);", 0, 0, 0) == SQLITE_OK;
+    }
+
+    // 5: the app password's hash and the scrypt parameters it was made with
+    static bool CreatePassword(sqlite3* db) {
+        return sqlite3_exec(db, "CREATE TABLE password ("
+                                "id INTEGER PRIMARY KEY CHECK (id = 1), "
+                                "salt BLOB NOT NULL, "
+                                "log_n INTEGER NOT NULL, "
+                                "r INTEGER NOT NULL, "
+                                "p INTEGER NOT NULL, "
+                                "hash BLOB NOT NULL);", 0, 0, 0) == SQLITE_OK;
+    }
+
+    // 6: a free-text label on every alarm, with an FTS5 index over it that
+    // reads the text from the alarms table itself; triggers keep the index
+    // in step with every insert, delete and change of label
+    static bool AddLabels(sqlite3* db) {
+        return sqlite3_exec(db, "ALTER TABLE alarms ADD COLUMN label TEXT NOT NULL DEFAULT '';",
+                            0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "CREATE VIRTUAL TABLE alarm_labels USING fts5("
+                                "label, content = 'alarms', content_rowid = 'id', "
+                                "tokenize = 'unicode61 remove_diacritics 2', prefix = '1 2');",
+                            0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "CREATE TRIGGER alarms_label_insert AFTER INSERT ON alarms BEGIN "
+                                "INSERT INTO alarm_labels (rowid, label) VALUES (new.id, new.label); "
+                                "END;", 0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "CREATE TRIGGER alarms_label_delete AFTER DELETE ON alarms BEGIN "
+                                "INSERT INTO alarm_labels (alarm_labels, rowid, label) "
+                                "VALUES ('delete', old.id, old.label); "
+                                "END;", 0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "CREATE TRIGGER alarms_label_update AFTER UPDATE OF label ON alarms BEGIN "
+                                "INSERT INTO alarm_labels (alarm_labels, rowid, label) "
+                                "VALUES ('delete', old.id, old.label); "
+                                "INSERT INTO alarm_labels (rowid, label) VALUES (new.id, new.label); "
+                                "END;", 0, 0, 0) == SQLITE_OK &&
+               sqlite3_exec(db, "INSERT INTO alarm_labels (alarm_labels) VALUES ('rebuild');",
+                            0, 0, 0) == SQLITE_OK;
+    }
+
+    // An FTS5 query for the words of `words`, each quoted so nothing typed
+    // reads as query syntax, and each a prefix; empty if there are none
+    static std::string LabelQuery(const std::string& words) {
+        std::string query;
+        for (size_t from = 0; from < words.size(); ) {
+            size_t end = words.find_first_of(" \t", from);
+            if (end == std::string::npos) end = words.size();
+            if (end > from) {
+                query += query.empty() ? "\"" : " \"";
+                for (size_t i = from; i < end; i++) {
+                    query += words[i] == '"' ? "\"\"" : std::string(1, words[i]);
+                }
+                query += "\"*";
+            }
+            from = end + 1;
+        }
+        return query;
+    }
+
+    // Names a key without giving it away: a hash of it, domain-separated
+    // from anything else the key is used for
+    static bool KeyId(const unsigned char* key, unsigned char* out) {
+        static const char kLabel[] = "alarms key id";
+        unsigned char input[sizeof(kLabel) + EncryptedVfs::kKeySize];
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        memcpy(input, kLabel, sizeof(kLabel));
+        memcpy(input + sizeof(kLabel), key, EncryptedVfs::kKeySize);
+        bool ok = EVP_Digest(input, sizeof(input), digest, nullptr, EVP_sha256(), nullptr) == 1;
+        OPENSSL_cleanse(input, sizeof(input));
+        memcpy(out, digest, kKeyIdSize);
+        return ok;
+    }
+
+    static bool IsPlaintext(const char* path) {
+        char header[16] = {};
+        FILE* in = fopen(path, "rb");
+        if (!in) {
+            return false;
+        }
+        bool plain = fread(header, sizeof(header), 1, in) == 1 && memcmp(header, "SQLite format 3", 16) == 0;
+        fclose(in);
+        return plain;
+    }
+
+    static void RemoveDatabase(const std::string& path) {
+        for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+            remove((path + suffix).c_str());
+        }
+    }
+
+    // Brings an unencrypted database up to date, copies it into a new
+    // encrypted file and swaps that in; until the rename the original is
+    // left as it was. `setAside` gets the upgrade's SetAsideByUpgrade().
+    static bool EncryptExisting(const char* path, const unsigned char* key, int* setAside) {
+        if (!IsPlaintext(path)) {
+            return true;
+        }
+        {
+            AlarmStore plain;
+            if (!plain.Open(path) || !plain.Upgrade()) {
+                return false;
+            }
+            *setAside = plain.SetAsideByUpgrade();
+        }
+
+        std::string tempPath = std::string(path) + ".encrypting";
+        RemoveDatabase(tempPath);
+        bool ok;
+        {
+            AlarmStore encrypted;
+            ok = encrypted.Open(tempPath.c_str(), key) && encrypted.Upgrade() && encrypted.CopyTables(path);
+        }
+        EncryptedVfs::RemoveKey(tempPath.c_str());
+        if (ok) {
+            RemoveDatabase(path);
+            ok = rename(tempPath.c_str(), path) == 0;
+        }
+        if (!ok) {
+            RemoveDatabase(tempPath);
+        }
+        return ok;
+    }
+
+    // Copies every table's rows from the database at `path`, which must have
+    // the same schema. Virtual tables and their shadow tables are left to the
+    // triggers that fill them as the rows go in.
+    bool CopyTables(const char* path) {
+        sqlite3_stmt* attach;
+        if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS source;", -1, &attach, 0) != SQLITE_OK) {
+            return false;
+        }
+        sqlite3_bind_text(attach, 1, path, -1, SQLITE_STATIC);
+        bool ok = sqlite3_step(attach) == SQLITE_DONE;
+        sqlite3_finalize(attach);
+        if (!ok) {
+            return false;
+        }
+
+        std::vector<std::string> tables;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "SELECT name FROM source.sqlite_master AS t "
+                                   "WHERE type = 'table' AND name NOT LIKE 'sqlite_%' "
+                                   "AND sql NOT LIKE 'CREATE VIRTUAL TABLE%' "
+                                   "AND NOT EXISTS (SELECT 1 FROM source.sqlite_master AS v "
+                                   "WHERE v.sql LIKE 'CREATE VIRTUAL TABLE%' "
+                                   "AND t.name LIKE v.name || '\\_%' ESCAPE '\\');", -1, &stmt, 0) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                tables.push_back((const char*)sqlite3_column_text(stmt, 0));
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        ok = sqlite3_exec(db, "BEGIN;", 0, 0, 0) == SQLITE_OK;
+        for (const std::string& table : tables) {
+            char* copy = sqlite3_mprintf("INSERT INTO main.\"%w\" SELECT * FROM source.\"%w\";",
+                                         table.c_str(), table.c_str());
+            ok = ok && sqlite3_exec(db, copy, 0, 0, 0) == SQLITE_OK;
+            sqlite3_free(copy);
+        }
+        ok = ok && sqlite3_exec(db, "COMMIT;", 0, 0, 0) == SQLITE_OK;
+        if (!ok) {
+            sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+        }
+        sqlite3_exec(db, "DETACH DATABASE source;", 0, 0, 0);
+        return ok;
+    }
+
+    // The update hook journals row ids as statements run; they are
+    // published to DrainChanges() only once their transaction commits
+    static void OnUpdate(void* context, int operation, const char* database, const char* table,
+                         sqlite3_int64 rowid) {
+        if (strcmp(database, "main") == 0 && strcmp(table, "alarms") == 0) {
+            static_cast<AlarmStore*>(context)->uncommitted.push_back({operation, (int)rowid});
+        }
+    }
+
+    static int OnCommit(void* context) {
+        AlarmStore* store = static_cast<AlarmStore*>(context);
+        store->journal.insert(store->journal.end(), store->uncommitted.begin(), store->uncommitted.end());
+        store->uncommitted.clear();
+        return 0;
+    }
+
+    static void OnRollback(void* context) {
+        static_cast<AlarmStore*>(context)->uncommitted.clear();
+    }
+
+    sqlite3* db = nullptr;
+    std::unordered_map<std::string, sqlite3_stmt*> statements;
+    std::vector<std::pair<int, int>> uncommitted; // (operation, id) in the open transaction
+    std::vector<std::pair<int, int>> journal;     // (operation, id) committed, not yet drained
+    sqlite3_stmt* labelSearch = nullptr;          // Set while a label search has matches left
+
+    // Set while a key rotation is under way
+    std::unique_ptr<EncryptedVfs::Rekeyer> rekeyer;
+    int64_t rotationCursor = 0; // First page not yet under the new key
+    wxStopWatch rotationWatch;
+
+    int setAside = 0; // See SetAsideByUpgrade()
+};
+
+const AlarmStore::Migration AlarmStore::kMigrations[AlarmStore::kSchemaVersion] = {
+    AlarmStore::CreateTextSchema,
+    AlarmStore::UseIntegerTimes,
+    AlarmStore::DropSecureAlarms,
+    AlarmStore::CreateKeyRotation,
+    AlarmStore::CreatePassword,
+    AlarmStore::AddLabels,
+};
+
+// Streams alarms between AlarmStore and CSV or iCalendar (VEVENT + RRULE)
+// files. Imports read one record at a time, validate it the way the alarm
+// form does and insert in large transactions; exports walk a database
+// cursor, so neither direction holds the whole table in memory.
+class AlarmTransfer {
+public:
+    struct Result {
+        int imported = 0;
+        int rejected = 0;
+        int firstRejectedLine = 0;
+        bool cancelled = false;
+    };
+
+    // Called after each committed batch with the bytes read so far; return
+    // false to stop. Batches already committed are kept.
+    typedef std::function<bool(long)> Progress;
+
+    static const int kBatchSize = 10000;
+
+    // time,day[,recurrence[,label]] per record; a leading "time,..." header
+    // is skipped. Quoted fields may hold newlines, so a record can span lines.
+    static bool ImportCsv(FILE* in, AlarmStore& store, Progress progress, Result* result) {
+        Batch batch(store, in, progress, result);
+        std::string line;
+        std::vector<std::string> fields;
+        int lines;
+        for (int lineNumber = 1; ReadCsvRecord(in, &line, &lines); lineNumber += lines) {
+            SplitCsv(line, &fields);
+            if (fields.empty() || (fields.size() == 1 && fields[0].empty())) {
+                continue;
+            }
+            if (lineNumber == 1 && fields[0] == "time") {
+                continue;
+            }
+
+            int minuteOfDay;
+            RecurrenceRule rule;
+            bool valid = ParseCsvAlarm(fields, fields.size() >= 2 ? DayMaskFromName(fields[1]) : 0, &minuteOfDay, &rule);
+            if (!batch.Add(lineNumber, valid, minuteOfDay, rule, fields.size() >= 4 ? fields[3] : "")) {
+                return false;
+            }
+        }
+        return batch.Finish();
+    }
+
+    // Each VEVENT becomes an alarm at its DTSTART time of day, repeating by
+    // its RRULE (or once, without one). UTC start times are converted to
+    // local time, and the RRULE days move with them when that changes the
+    // date; other time zones are taken as local.
+    static bool ImportICalendar(FILE* in, AlarmStore& store, const LocalTimeZone& zone,
+                                Progress progress, Result* result) {
+        Batch batch(store, in, progress, result);
+        std::string line, next;
+        bool inEvent = false, valid = false, haveNext = ReadLine(in, &next);
+        int lineNumber = 0, eventLine = 0, minuteOfDay = 0, dayShift = 0;
+        int32_t startDay = 0;
+        std::string rrule, exdates, summary;
+        while (haveNext) {
+            // Lines starting with a space or tab continue the previous one
+            line.swap(next);
+            lineNumber++;
+            while ((haveNext = ReadLine(in, &next)) && !next.empty() && (next[0] == ' ' || next[0] == '\t')) {
+                line.append(next, 1, std::string::npos);
+                lineNumber++;
+            }
+
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(0, std::min(colon, line.find(';')));
+            std::string value = line.substr(colon + 1);
+            if (name == "BEGIN" && value == "VEVENT") {
+                inEvent = valid = true;
+                eventLine = lineNumber;
+                startDay = -1;
+                rrule.clear();
+                exdates.clear();
+                summary.clear();
+            } else if (!inEvent) {
+                continue;
+            } else if (name == "DTSTART") {
+                valid = valid && ParseDateTime(value, zone, &startDay, &minuteOfDay, &dayShift);
+            } else if (name == "RRULE") {
+                valid = valid && CheckRRule(value, &rrule);
+            } else if (name == "SUMMARY") {
+                summary = UnescapeText(value);
+            } else if (name == "EXDATE") {
+                for (size_t from = 0; from < value.size(); ) {
+                    size_t comma = value.find(',', from);
+                    if (comma == std::string::npos) comma = value.size();
+                    std::string item = value.substr(from, comma - from);
+                    int32_t day;
+                    int minute, shift;
+                    if (item.size() >= 15 && ParseDateTime(item, zone, &day, &minute, &shift)) {
+                        item = RecurrenceRule::FormatDate(day);
+                    }
+                    exdates += (exdates.empty() ? "" : ",") + item.substr(0, 8);
+                    from = comma + 1;
+                }
+            } else if (name == "END" && value == "VEVENT") {
+                inEvent = false;
+                RecurrenceRule rule;
+                if (valid && startDay >= 0) {
+                    // The RRULE is read against the start date as written and
+                    // then moved to the local one
+                    std::string date = RecurrenceRule::FormatDate(startDay);
+                    std::string text = rrule.empty() ? "FREQ=DAILY;UNTIL=" + date : rrule;
+                    text += ";DTSTART=" + RecurrenceRule::FormatDate(rrule.empty() ? startDay : startDay - dayShift);
+                    if (!exdates.empty()) {
+                        text += ";EXDATE=" + exdates;
+                    }
+                    valid = rule.Parse(text) && (rrule.empty() || ShiftRule(&rule, dayShift));
+                } else {
+                    valid = false;
+                }
+                if (!batch.Add(eventLine, valid, minuteOfDay, rule, summary)) {
+                    return false;
+                }
+            }
+        }
+        return batch.Finish();
+    }
+
+    static bool ExportCsv(FILE* out, AlarmStore& store) {
+        fputs("time,day,recurrence,label\n", out);
+        store.ForEachAlarm([&](int id, int minuteOfDay, unsigned dayMask, const char* recurrence,
+                               const char* label) {
+            std::string quoted;
+            for (const char* c = label; *c; c++) {
+                quoted += *c == '"' ? "\"\"" : std::string(1, *c);
+            }
+            fprintf(out, "%s,\"%s\",\"%s\",\"%s\"\n", FormatMinuteOfDay(minuteOfDay).c_str(),
+                    DayMaskName(dayMask).c_str(), recurrence ? recurrence : "", quoted.c_str());
+        });
+        return fflush(out) == 0 && !ferror(out);
+    }
+
+    // `today` (days since the epoch, local) anchors rules without a start date
+    static bool ExportICalendar(FILE* out, AlarmStore& store, int32_t today) {
+        time_t now = time(0);
+        int32_t utcDay = (int32_t)(now / 86400);
+        int secondOfDay = (int)(now % 86400);
+        char stamp[32];
+        snprintf(stamp, sizeof(stamp), "%sT%02d%02d%02dZ", RecurrenceRule::FormatDate(utcDay).c_str(),
+                 secondOfDay / 3600, secondOfDay / 60 % 60, secondOfDay % 60);
+
+        fputs("BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//Desktop Alarm//EN\r\n", out);
+        store.ForEachAlarm([&](int id, int minuteOfDay, unsigned dayMask, const char* recurrence,
+                               const char* label) {
+            RecurrenceRule rule;
+            if (!recurrence || !rule.Parse(recurrence)) {
+                rule = RecurrenceRule();
+                rule.weekdays = dayMask & kEveryDayMask;
+            }
+            int32_t first = rule.startDay != 0 ? rule.startDay : rule.NextDay(today);
+            if (rule.weekdays == 0 || first == RecurrenceRule::kNever) {
+                return;
+            }
+            char start[32];
+            snprintf(start, sizeof(start), "%sT%02d%02d00", RecurrenceRule::FormatDate(first).c_str(),
+                     minuteOfDay / 60, minuteOfDay % 60);
+
+            // DTSTART, UNTIL and EXDATE are separate properties or need a time in iCalendar
+            RecurrenceRule repeat = rule;
+            repeat.startDay = 0;
+            repeat.endDay = RecurrenceRule::kNever;
+            repeat.skipDays.clear();
+            std::string rrule = repeat.Format();
+            if (rule.endDay != RecurrenceRule::kNever) {
+                rrule += ";UNTIL=" + RecurrenceRule::FormatDate(rule.endDay) + "T235959";
+            }
+
+            fprintf(out, "BEGIN:VEVENT\r\nUID:alarm-%d@desktop-alarm\r\nDTSTAMP:%s\r\nDTSTART:%s\r\nRRULE:%s\r\n",
+                    id, stamp, start, rrule.c_str());
+            for (size_t i = 0; i < rule.skipDays.size(); i++) {
+                fprintf(out, "%s%sT%02d%02d00", i == 0 ? "EXDATE:" : ",",
+                        RecurrenceRule::FormatDate(rule.skipDays[i]).c_str(), minuteOfDay / 60, minuteOfDay % 60);
+            }
+            fputs(rule.skipDays.empty() ? "" : "\r\n", out);
+            fprintf(out, "SUMMARY:%s\r\nEND:VEVENT\r\n", *label ? EscapeText(label).c_str() : "Alarm");
+        });
+        fputs("END:VCALENDAR\r\n", out);
+        return fflush(out) == 0 && !ferror(out);
+    }
+
+private:
+    // Groups inserts into transactions of kBatchSize rows
+    class Batch {
+    public:
+        Batch(AlarmStore& store, FILE* in, Progress progress, Result* result)
+            : store(store), in(in), progress(progress), result(result) {}
+
+        ~Batch() {
+            if (pending) {
+                store.Rollback();
+            }
+        }
+
+        // Returns false once the import has to stop
+        bool Add(int line, bool valid, int minuteOfDay, const RecurrenceRule& rule, const std::string& label) {
+            if (!valid) {
+                if (result->rejected++ == 0) {
+                    result->firstRejectedLine = line;
+                }
+                return true;
+            }
+            if (pending == 0 && !store.Begin()) {
+                return false;
+            }
+            // Plain weekly rules are stored as just the day mask
+            std::string recurrence = rule.IsPlainWeekly() ? "" : rule.Format();
+            if (store.InsertAlarm(minuteOfDay, rule.weekdays, recurrence.empty() ? nullptr : recurrence.c_str(),
+                                  label) == 0) {
+                return false;
+            }
+            return ++pending < kBatchSize || Flush();
+        }
+
+        bool Finish() {
+            return Flush();
+        }
+
+    private:
+        bool Flush() {
+            if (pending && !store.Commit()) {
+                return false;
+            }
+            result->imported += pending;
+            pending = 0;
+            if (progress && !progress(ftell(in))) {
+                result->cancelled = true;
+                return false;
+            }
+            return true;
+        }
+
+        AlarmStore& store;
+        FILE* in;
+        Progress progress;
+        Result* result;
+        int pending = 0;
+    };
+
+    // iCalendar TEXT values escape backslashes, commas, semicolons and newlines
+    static std::string EscapeText(const char* text) {
+        std::string escaped;
+        for (; *text; text++) {
+            if (*text == '\\' || *text == ',' || *text == ';') {
+                escaped += '\\';
+            }
+            escaped += *text == '\n' ? std::string("\\n") : std::string(1, *text);
+        }
+        return escaped;
+    }
+
+    // Newlines come out as spaces; a label is one line
+    static std::string UnescapeText(const std::string& value) {
+        std::string text;
+        for (size_t i = 0; i < value.size(); i++) {
+            if (value[i] == '\\' && i + 1 < value.size()) {
+                char next = value[++i];
+                text += next == 'n' || next == 'N' ? ' ' : next;
+            } else {
+                text += value[i];
+            }
+        }
+        return text;
+    }
+
+    // Moves a rule read against a UTC start date onto the local date
+    // `days` away. Weekdays turn with it and a month day moves while it
+    // stays a day every month has; an nth weekday does not map onto another
+    // nth weekday, so those rules are refused.
+    static bool ShiftRule(RecurrenceRule* rule, int days) {
+        rule->startDay += days;
+        if (days == 0 || rule->frequency == RecurrenceRule::Daily) {
+            return true;
+        }
+        if (rule->frequency == RecurrenceRule::Weekly) {
+            int turn = (days % 7 + 7) % 7;
+            rule->weekdays = ((rule->weekdays << turn) | (rule->weekdays >> (7 - turn))) & kEveryDayMask;
+            return true;
+        }
+        if (rule->nthWeek != 0) {
+            return false;
+        }
+        int monthDay = rule->monthDay + days;
+        if (rule->monthDay == -1 && days == 1) {
+            monthDay = 1;
+        } else if (rule->monthDay == 1 && days == -1) {
+            monthDay = -1;
+        } else if (rule->monthDay < 1 || rule->monthDay > 28 || monthDay < 1 || monthDay > 28) {
+            return false;
+        }
+        rule->monthDay = monthDay;
+        return true;
+    }
+
+    // YYYYMMDDTHHMMSS, optionally with a trailing Z for UTC. `dayShift` is
+    // how many days converting to local time moved the date.
+    static bool ParseDateTime(const std::string& value, const LocalTimeZone& zone, int32_t* day, int* minuteOfDay,
+                              int* dayShift) {
+        int hours, minutes, seconds;
+        if (value.size() < 15 || value[8] != 'T' || !RecurrenceRule::ParseDate(value, day) ||
+            sscanf(value.c_str() + 9, "%2d%2d%2d", &hours, &minutes, &seconds) != 3 ||
+            hours > 23 || minutes > 59) {
+            return false;
+        }
+        *dayShift = 0;
+        if (value.back() == 'Z') {
+            int64_t localMinute = zone.LocalMinute((time_t)*day * 86400 + hours * 3600 + minutes * 60 + seconds);
+            int32_t written = *day;
+            *day = (int32_t)FloorDiv(localMinute, 24 * 60);
+            *minuteOfDay = (int)(localMinute - (int64_t)*day * 24 * 60);
+            *dayShift = *day - written;
+        } else {
+            *minuteOfDay = hours * 60 + minutes;
+        }
+        return true;
+    }
+
+    // Keeps the RRULE parts RecurrenceRule understands and refuses rules
+    // that rely on anything else (COUNT, BYMONTH, ...)
+    static bool CheckRRule(const std::string& value, std::string* rrule) {
+        rrule->clear();
+        for (size_t from = 0; from < value.size(); ) {
+            size_t semicolon = value.find(';', from);
+            if (semicolon == std::string::npos) semicolon = value.size();
+            std::string part = value.substr(from, semicolon - from);
+            from = semicolon + 1;
+            std::string key = part.substr(0, part.find('='));
+            if (key == "WKST") {
+                continue;
+            }
+            if (key != "FREQ" && key != "INTERVAL" && key != "BYDAY" && key != "BYMONTHDAY" && key != "UNTIL") {
+                return false;
+            }
+            *rrule += (rrule->empty() ? "" : ";") + part;
+        }
+        return !rrule->empty();
+    }
+};
+
+// A copy of the alarms table in a file that loads with one mmap and one
+// decrypt, so startup need not walk SQLite row by row. It is written on
+// exit once the last connection has closed, and by DatabaseWriter once its
+// writes have settled, and carries the size and modification times of
+// alarms.db and its WAL as they were then; any write since, including one
+// lost to a crash, leaves the stamp stale and the table is read from
+// SQLite as usual. The body is sealed with the database
+// key, so it is no more readable than the database and damage shows up as
+// a failed load.
+class AlarmSnapshot {
+public:
+    // False if the file is missing, stale, damaged or sealed with another key
+    bool Load(const char* path, const char* databasePath, const unsigned char* key) {
+        Clear();
+#ifdef __LINUX__
+        Stamp stamp;
+        if (!key || !StampDatabase(databasePath, &stamp)) {
+            return false;
+        }
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat info;
+        void* mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Header)) {
+            mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        }
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+
+        Header header;
+        memcpy(&header, mapped, sizeof(header));
+        uint64_t sealedSize = info.st_size - sizeof(Header);
+        bool ok = memcmp(header.magic, kMagic, sizeof(header.magic)) == 0 &&
+                  header.version == kVersion &&
+                  memcmp(&header.stamp, &stamp, sizeof(stamp)) == 0 &&
+                  header.bodySize == sealedSize && sealedSize < INT_MAX &&
+                  sealedSize > (uint64_t)header.count * sizeof(Record);
+        if (ok) {
+            body.reset(new unsigned char[sealedSize]); // Left uninitialized; the decrypt fills it
+            bodySize = sealedSize;
+            ok = Seal(false, key, &header, (const unsigned char*)mapped + sizeof(Header), body.get());
+        }
+        munmap(mapped, info.st_size);
+        if (ok) {
+            count = header.count;
+            ok = Check();
+        }
+        if (!ok) {
+            Clear();
+        }
+        return ok;
+#else
+        return false;
+#endif
+    }
+
+    // Reads every alarm in `store` in; Save() once the store is closed
+    bool Collect(AlarmStore& store) {
+        Clear();
+        if (!store.Handle()) {
+            return false;
+        }
+        std::vector<Record> records;
+        std::string strings(1, '\0'); // Offset 0 is the empty string, for no rule or label
+        store.ForEachAlarm([&](int id, int minuteOfDay, unsigned dayMask, const char* recurrence,
+                               const char* label) {
+            Record record = {id, minuteOfDay, dayMask, 0, 0};
+            if (recurrence && *recurrence) {
+                record.recurrence = (uint32_t)strings.size();
+                strings.append(recurrence, strlen(recurrence) + 1);
+            }
+            if (*label) {
+                record.label = (uint32_t)strings.size();
+                strings.append(label, strlen(label) + 1);
+            }
+            records.push_back(record);
+        });
+        if (sqlite3_errcode(store.Handle()) != SQLITE_OK) {
+            return false;
+        }
+        std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+            return std::tie(a.minuteOfDay, a.dayMask, a.id) < std::tie(b.minuteOfDay, b.dayMask, b.id);
+        });
+
+        count = records.size();
+        bodySize = count * sizeof(Record) + strings.size();
+        body.reset(new unsigned char[bodySize]);
+        memcpy(body.get(), records.data(), count * sizeof(Record));
+        memcpy(body.get() + count * sizeof(Record), strings.data(), strings.size());
+        return true;
+    }
+
+    // Stamps the file with the database as it is now, so call it only once
+    // every connection to `databasePath` is closed, or from the only one
+    // that writes, with nothing written since Collect()
+    bool Save(const char* path, const char* databasePath, const unsigned char* key) const {
+#ifdef __LINUX__
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.version = kVersion;
+        header.count = (uint32_t)count;
+        header.bodySize = bodySize;
+        std::vector<unsigned char> sealed(bodySize);
+        if (!key || !body || bodySize >= INT_MAX || !StampDatabase(databasePath, &header.stamp) ||
+            RAND_bytes(header.iv, sizeof(header.iv)) != 1 ||
+            !Seal(true, key, &header, body.get(), sealed.data())) {
+            return false;
+        }
+
+        // No fsync: a snapshot torn by a crash fails to decrypt and is rebuilt
+        std::string tempPath = std::string(path) + ".tmp";
+        FILE* out = fopen(tempPath.c_str(), "wb");
+        if (!out) {
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  fwrite(sealed.data(), sealed.size(), 1, out) == 1;
+        ok = fclose(out) == 0 && ok;
+        if (!ok || rename(tempPath.c_str(), path) != 0) {
+            remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void Clear() {
+        body.reset();
+        bodySize = 0;
+        count = 0;
+    }
+
+    size_t Count() const {
+        return count;
+    }
+
+    // fn(id, minuteOfDay, dayMask, recurrence, label) ordered by time, day
+    // mask and id, like AlarmStore::ForEachAlarmByTime; recurrence may be
+    // null, label is never
+    template <typename Fn>
+    void ForEachAlarm(Fn fn) const {
+        const Record* records = (const Record*)body.get();
+        const char* strings = (const char*)(records + count);
+        for (size_t i = 0; i < count; i++) {
+            const Record& record = records[i];
+            fn(record.id, record.minuteOfDay, record.dayMask,
+               record.recurrence ? strings + record.recurrence : nullptr, strings + record.label);
+        }
+    }
+
+private:
+    static constexpr const char* kMagic = "ALRMSNP1";
+    static const uint32_t kVersion = 2; // 2: records carry the label
+
+    // What the database files looked like; a WAL that is missing has size -1
+    struct Stamp {
+        uint64_t device;
+        uint64_t inode;
+        int64_t size;
+        int64_t modifiedNs;
+        int64_t walSize;
+        int64_t walModifiedNs;
+    };
+
+    struct Header {
+        unsigned char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t bodySize;
+        Stamp stamp;
+        unsigned char iv[12];
+        unsigned char tag[16]; // Covers the header up to here and the body
+    };
+
+    // Fixed width, followed by the rules and labels as NUL terminated strings
+    struct Record {
+        int32_t id;
+        int32_t minuteOfDay;
+        uint32_t dayMask;
+        uint32_t recurrence; // Offsets into the strings; 0 for none
+        uint32_t label;
+    };
+
+#ifdef __LINUX__
+    static bool StampDatabase(const char* databasePath, Stamp* stamp) {
+        struct stat info;
+        if (stat(databasePath, &info) != 0) {
+            return false;
+        }
+        memset(stamp, 0, sizeof(*stamp));
+        stamp->device = info.st_dev;
+        stamp->inode = info.st_ino;
+        stamp->size = info.st_size;
+        stamp->modifiedNs = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        stamp->walSize = -1;
+        if (stat((std::string(databasePath) + "-wal").c_str(), &info) == 0) {
+            stamp->walSize = info.st_size;
+            stamp->walModifiedNs = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        }
+        return true;
+    }
+#endif
+
+    // AES-256-GCM over the body, with the rest of the header as associated data
+    static bool Seal(bool encrypt, const unsigned char* key, Header* header, const unsigned char* in,
+                     unsigned char* out) {
+        int length;
+        int size = (int)header->bodySize;
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        bool ok = ctx && EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key, header->iv, encrypt) == 1 &&
+                  EVP_CipherUpdate(ctx, nullptr, &length, (const unsigned char*)header,
+                                   offsetof(Header, tag)) == 1 &&
+                  (encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, sizeof(header->tag),
+                                                  header->tag) == 1) &&
+                  EVP_CipherUpdate(ctx, out, &length, in, size) == 1 &&
+                  EVP_CipherFinal_ex(ctx, out + length, &length) == 1 &&
+                  (!encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, sizeof(header->tag),
+                                                   header->tag) == 1);
+        EVP_CIPHER_CTX_free(ctx);
+        return ok;
+    }
+
+    // Every string offset has to land inside the strings, which end in a NUL
+    bool Check() const {
+        size_t stringsSize = bodySize - count * sizeof(Record);
+        const Record* records = (const Record*)body.get();
+        if (body[bodySize - 1] != '\0') {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].recurrence >= stringsSize || records[i].label >= stringsSize) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::unique_ptr<unsigned char[]> body; // The records, then the strings
+    size_t bodySize = 0;
+    size_t count = 0;
+};
+
+// Payload: std::vector<AlarmChange> committed by one batch of writes. The
+// string holds the first failed write's message, empty if all succeeded.
+// Int: 1 if too many rows changed to list, so everything has to be reread.
+wxDEFINE_EVENT(EVT_DATABASE_WRITTEN, wxThreadEvent);
+// Int: percent of the database re-encrypted under the new key so far, 100
+// once the rotation is finished, or -1 if it failed
+wxDEFINE_EVENT(EVT_KEY_ROTATION_PROGRESS, wxThreadEvent);
+// Int: thousandths of the file being imported read so far
+wxDEFINE_EVENT(EVT_IMPORT_PROGRESS, wxThreadEvent);
+// Payload: the import's AlarmTransfer::Result. Int: 1 if every batch was
+// saved, 0 if one failed or the import was cancelled.
+wxDEFINE_EVENT(EVT_IMPORT_FINISHED, wxThreadEvent);
+
+// Applies database writes on a thread of its own, with its own connection,
+// so a slow fsync never holds up the GUI. Writes queued while a batch is
+// being committed go into the next batch, and each batch is one
+// transaction; every write runs in a savepoint so one failing doesn't take
+// the rest of its batch with it. The GUI is told what changed through
+// EVT_DATABASE_WRITTEN. Imports run as one job, committing the writes
+// queued meanwhile between their batches. The thread also owns the database key: a key
+// rotation runs a batch of pages at a time whenever no writes are waiting,
+// reporting EVT_KEY_ROTATION_PROGRESS, and resumes after a restart. Once
+// nothing has been written for a while the thread rewrites the alarm
+// snapshot, so a start after a crash can still skip reading SQLite.
+class DatabaseWriter : public wxThread {
+public:
+    // Returns false if the write failed, which rolls it back
+    typedef std::function<bool(AlarmStore&)> Write;
+
+    DatabaseWriter(wxEvtHandler* sink, const std::string& path, const std::string& keyPath,
+                   const std::string& snapshotPath, const DatabaseKey& key)
+        : wxThread(wxTHREAD_JOINABLE), sink(sink), path(path), keyPath(keyPath), snapshotPath(snapshotPath),
+          key(key), wakeup(queueLock) {}
+
+    // The calls below may be made from any thread; `failure` is reported
+    // if the write fails. A write that is not `transactional` runs between
+    // batches, outside any transaction, and does its own.
+
+    void Post(Write write, const wxString& failure, bool transactional = true) {
+        wxMutexLocker lock(queueLock);
+        queue.push_back({std::move(write), failure, transactional});
+        wakeup.Signal();
+    }
+
+    void InsertAlarm(int minuteOfDay, unsigned dayMask, const std::string& label) {
+        Post([minuteOfDay, dayMask, label](AlarmStore& store) {
+            return store.InsertAlarm(minuteOfDay, dayMask, nullptr, label) != 0;
+        }, _("Failed to save alarm to the database!"));
+    }
+
+    void DeleteAlarm(int id) {
+        Post([id](AlarmStore& store) {
+            return store.DeleteAlarm(id);
+        }, _("Failed to delete alarm from the database!"));
+    }
+
+    // Reads alarms from `in`, which is `size` bytes long and closed once
+    // read, reporting EVT_IMPORT_PROGRESS after every batch and then
+    // EVT_IMPORT_FINISHED. Setting `cancel` stops it after the current batch.
+    void ImportAlarms(FILE* in, long size, bool iCalendar, const LocalTimeZone& zone,
+                      std::shared_ptr<std::atomic<bool>> cancel) {
+        auto job = std::make_shared<ImportJob>(sink, in, size, iCalendar, zone, std::move(cancel));
+        Post([this, job](AlarmStore& store) {
+            AlarmTransfer::Progress progress = [this, job](long bytesDone) {
+                CommitQueuedWrites();
+                wxThreadEvent* event = new wxThreadEvent(EVT_IMPORT_PROGRESS);
+                event->SetInt((int)std::min(999.0, 1000.0 * bytesDone / std::max(1L, job->size)));
+                wxQueueEvent(sink, event);
+                return !*job->cancel;
+            };
+            job->ok = job->iCalendar
+                          ? AlarmTransfer::ImportICalendar(job->in, store, job->zone, progress, &job->result)
+                          : AlarmTransfer::ImportCsv(job->in, store, progress, &job->result);
+            return true; // Reported through EVT_IMPORT_FINISHED instead
+        }, _("Failed to save alarms to the database!"), false);
+    }
+
+    // Stores `hash`, made from `password`, then wraps a new database key
+    // under `password` and re-encrypts every page with it in the background
+    void ChangePassword(const std::string& password, const PasswordHash& hash) {
+        SetPasswordHash(hash);
+        Post([this, password](AlarmStore& store) {
+            return RotateKey(store, password);
+        }, _("Failed to re-encrypt database!"), false);
+    }
+
+    void SetPasswordHash(const PasswordHash& hash) {
+        Post([hash](AlarmStore& store) {
+            return store.SavePasswordHash(hash);
+        }, _("Failed to save the password!"));
+    }
+
+    // Carries on with a rotation a previous run didn't finish; `password`
+    // is the one its key file is wrapped under
+    void ResumeKeyRotation(const std::string& password) {
+        Post([this, password](AlarmStore& store) {
+            if (!key.Previous() || store.RotatingKey()) {
+                return true;
+            }
+            rotationPassword = password;
+            return store.BeginKeyRotation(key.Data(), key.Previous());
+        }, _("Failed to re-encrypt database!"), false);
+    }
+
+    // Commits everything already queued, then stops the thread and waits for
+    // it. A key rotation under way is left to resume on the next run.
+    void Shutdown() {
+        {
+            wxMutexLocker lock(queueLock);
+            stopping = true;
+            wakeup.Signal();
+        }
+        Wait();
+    }
+
+    // The key the database is under; only once the thread has been shut down
+    const DatabaseKey& Key() const {
+        return key;
+    }
+
+protected:
+    ExitCode Entry() override {
+        bool opened = store.Open(path.c_str(), key.Data(), key.Previous());
+        for (;;) {
+            std::vector<Pending> batch;
+            bool settled = false;
+            {
+                wxMutexLocker lock(queueLock);
+                while (queue.empty() && !stopping && !store.RotatingKey() && !settled) {
+                    if (!snapshotStale) {
+                        wakeup.Wait();
+                    } else {
+                        settled = wakeup.WaitTimeout(kSnapshotDelayMs) == wxCOND_TIMEOUT;
+                    }
+                }
+                if (queue.empty() && stopping) {
+                    break;
+                }
+                // A write outside transactions ends the batch, so what was
+                // queued after an import is left for CommitQueuedWrites
+                auto end = std::find_if(queue.begin(), queue.end(), [](const Pending& pending) {
+                    return !pending.transactional;
+                });
+                end = end == queue.end() ? end : end + 1;
+                batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(end));
+                queue.erase(queue.begin(), end);
+            }
+            // Writes go first, so a rotation holds them up one batch at most
+            if (!batch.empty()) {
+                Commit(batch, opened);
+                snapshotStale = opened;
+            } else if (store.RotatingKey()) {
+                StepKeyRotation();
+                snapshotStale = true;
+            } else if (settled) {
+                SaveSnapshot();
+            }
+        }
+        store.Close();
+        OPENSSL_cleanse(&rotationPassword[0], rotationPassword.size());
+        return 0;
+    }
+
+private:
+    struct Pending {
+        Write write;
+        wxString failure;
+        bool transactional;
+    };
+
+    // Reports the import finished when the writer lets go of it, which it
+    // does even if the database never opened and the import never ran
+    struct ImportJob {
+        ImportJob(wxEvtHandler* sink, FILE* in, long size, bool iCalendar, const LocalTimeZone& zone,
+                  std::shared_ptr<std::atomic<bool>> cancel)
+            : sink(sink), in(in), size(size), iCalendar(iCalendar), zone(zone), cancel(std::move(cancel)) {}
+
+        ~ImportJob() {
+            fclose(in);
+            wxThreadEvent* event = new wxThreadEvent(EVT_IMPORT_FINISHED);
+            event->SetPayload(result);
+            event->SetInt(ok);
+            wxQueueEvent(sink, event);
+        }
+
+        wxEvtHandler* sink;
+        FILE* in;
+        long size;
+        bool iCalendar;
+        LocalTimeZone zone;
+        std::shared_ptr<std::atomic<bool>> cancel;
+        AlarmTransfer::Result result;
+        bool ok = false;
+    };
+
+    // Past this many changed rows the GUI is told to reload instead
+    static const size_t kMaxReportedChanges = AlarmTransfer::kBatchSize;
+
+    void Commit(std::vector<Pending>& batch, bool opened) {
+        wxStopWatch watch;
+        wxString failure;
+        size_t next = 0;
+        while (next < batch.size()) {
+            if (!batch[next].transactional) {
+                if ((!opened || !batch[next].write(store)) && failure.empty()) {
+                    failure = batch[next].failure;
+                }
+                next++;
+                continue;
+            }
+            size_t end = next;
+            while (end < batch.size() && batch[end].transactional) {
+                end++;
+            }
+            CommitRun(batch.data() + next, batch.data() + end, opened, &failure);
+            next = end;
+        }
+        wxLogTrace(TRACE_TIMING, "Committed %zu writes in %ld ms", batch.size(), watch.Time());
+
+        std::vector<AlarmChange> changes;
+        bool reload = store.PendingChanges() > kMaxReportedChanges;
+        if (reload) {
+            store.DiscardChanges();
+        } else {
+            store.DrainChanges([&](const AlarmChange& change) {
+                changes.push_back(change);
+            });
+        }
+        wxThreadEvent* event = new wxThreadEvent(EVT_DATABASE_WRITTEN);
+        event->SetPayload(changes);
+        event->SetString(failure);
+        event->SetInt(reload);
+        wxQueueEvent(sink, event);
+    }
+
+    // Between an import's batches, so edits made meanwhile aren't held up
+    // behind it. Writes that run outside transactions wait their turn.
+    void CommitQueuedWrites() {
+        std::vector<Pending> batch;
+        {
+            wxMutexLocker lock(queueLock);
+            auto end = std::stable_partition(queue.begin(), queue.end(), [](const Pending& pending) {
+                return pending.transactional;
+            });
+            batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(end));
+            queue.erase(queue.begin(), end);
+        }
+        if (!batch.empty()) {
+            Commit(batch, true);
+        }
+    }
+
+    // Runs writes [first, last) in one transaction
+    void CommitRun(Pending* first, Pending* last, bool opened, wxString* failure) {
+        sqlite3* db = store.Handle();
+        bool began = opened && store.Begin();
+        for (Pending* pending = first; pending != last; pending++) {
+            bool ok = began && sqlite3_exec(db, "SAVEPOINT write;", 0, 0, 0) == SQLITE_OK;
+            if (ok && pending->write(store)) {
+                sqlite3_exec(db, "RELEASE write;", 0, 0, 0);
+                continue;
+            }
+            if (ok) {
+                sqlite3_exec(db, "ROLLBACK TO write; RELEASE write;", 0, 0, 0);
+            }
+            if (failure->empty()) {
+                *failure = pending->failure;
+            }
+        }
+        if (began && !store.Commit()) {
+            store.Rollback();
+            *failure = first->failure;
+        }
+    }
+
+    // The key file names both keys until every page is under the new one.
+    // A rotation still under way can't be cut short, as starting another
+    // would drop the only key its remaining pages open with; the key file
+    // is wrapped under the new password now and the next rotation starts
+    // once this one has gone through, a batch at a time between writes.
+    bool RotateKey(AlarmStore& store, const std::string& password) {
+        rotationPassword = password;
+        if (key.Previous()) {
+            rotateAgain = true;
+            return key.Save(keyPath, password) &&
+                   (store.RotatingKey() || store.BeginKeyRotation(key.Data(), key.Previous()));
+        }
+        return BeginKeyRotation();
+    }
+
+    bool BeginKeyRotation() {
+        DatabaseKey next = key;
+        if (!next.Rotate() || !next.Save(keyPath, rotationPassword)) {
+            return false;
+        }
+        key = next;
+        reportedPercent = -1;
+        return store.BeginKeyRotation(key.Data(), key.Previous());
+    }
+
+    // Nothing else writes to the database, so the stamp taken now matches
+    // what was read
+    void SaveSnapshot() {
+        AlarmSnapshot snapshot;
+        if (snapshot.Collect(store)) {
+            snapshot.Save(snapshotPath.c_str(), path.c_str(), key.Data());
+        }
+        snapshotStale = false;
+    }
+
+    // Once the last page is done the key file drops the old key, unless a
+    // password change is waiting to rotate it again
+    void StepKeyRotation() {
+        bool ok = store.StepKeyRotation();
+        if (ok && !store.RotatingKey()) {
+            key.FinishRotation();
+            ok = rotateAgain ? BeginKeyRotation() : key.Save(keyPath, rotationPassword);
+            rotateAgain = false;
+        }
+        if (!ok || !store.RotatingKey()) {
+            OPENSSL_cleanse(&rotationPassword[0], rotationPassword.size());
+            rotationPassword.clear();
+            rotateAgain = false;
+        }
+        int percent = !ok ? -1 : store.RotatingKey() ? std::min(99, store.KeyRotationPercent()) : 100;
+        if (!ok) {
+            wxThreadEvent* event = new wxThreadEvent(EVT_DATABASE_WRITTEN);
+            event->SetPayload(std::vector<AlarmChange>());
+            event->SetString(_("Failed to re-encrypt database!"));
+            wxQueueEvent(sink, event);
+        }
+        if (percent != reportedPercent) {
+            reportedPercent = percent;
+            wxThreadEvent* event = new wxThreadEvent(EVT_KEY_ROTATION_PROGRESS);
+            event->SetInt(percent);
+            wxQueueEvent(sink, event);
+        }
+    }
+
+    // How long the database has to go unwritten before the snapshot is
+    // rewritten; a burst of edits then costs one rewrite
+    static const int kSnapshotDelayMs = 2000;
+
+    wxEvtHandler* sink;
+    std::string path;
+    std::string keyPath;
+    std::string snapshotPath;
+    DatabaseKey key; // Touched only by the writer thread once it runs
+
+    // Touched only by the writer thread
+    AlarmStore store;
+    std::string rotationPassword; // Wraps the key file while a rotation runs
+    bool rotateAgain = false;     // The password changed while the rotation ran
+    int reportedPercent = -1;
+    bool snapshotStale = false; // Written since the snapshot was last saved
+
+    // Guarded by queueLock
+    wxMutex queueLock;
+    wxCondition wakeup;
+    std::vector<Pending> queue;
+    bool stopping = false;
+};
+
+wxDEFINE_EVENT(EVT_BACKGROUND_TASK_DONE, wxThreadEvent);
+
+// Runs one slow piece of work, such as a password derivation, off the GUI
+// thread and posts EVT_BACKGROUND_TASK_DONE to `sink` once it has; the
+// sink then Wait()s for the thread and picks the result up.
+class BackgroundTask : public wxThread {
+public:
+    BackgroundTask(wxEvtHandler* sink, std::function<void()> work)
+        : wxThread(wxTHREAD_JOINABLE), sink(sink), work(std::move(work)) {}
+
+protected:
+    ExitCode Entry() override {
+        work();
+        wxQueueEvent(sink, new wxThreadEvent(EVT_BACKGROUND_TASK_DONE));
+        return 0;
+    }
+
+private:
+    wxEvtHandler* sink;
+    std::function<void()> work;
+};
+
+// --benchmark: insert, delete and list throughput of AlarmStore against the
+// original text schema with SQL built and compiled on every call, then bulk
+// CSV import and export
+static void RunStoreBenchmark() {
+    const int inserts = 20000;
+    const int deletes = 24 * 60;
+    const int lists = 20000;
+    const int listed = 50; // A realistic alarm list
+    auto timeOf = [](int i) {
+        char buffer[6];
+        snprintf(buffer, sizeof(buffer), "%02d:%02d", i / 60 % 24, i % 60);
+        return std::string(buffer);
+    };
+    auto report = [](const char* what, int count, long ms) {
+        printf("  %-8s %7d in %5ld ms  (%.0f/s)\n", what, count, ms, count * 1000.0 / std::max(1L, ms));
+    };
+
+    printf("Text schema, SQL compiled per call:\n");
+    {
+        sqlite3* db;
+        sqlite3_open(":memory:", &db);
+        sqlite3_exec(db, "CREATE TABLE alarms (id INTEGER PRIMARY KEY, time TEXT, "
+                         "day TEXT DEFAULT 'Every Day', recurrence TEXT);", 0, 0, 0);
+        auto insert = [&](int i) {
+            std::string query = "INSERT INTO alarms (time, day) VALUES ('" + timeOf(i) + "', 'Monday');";
+            sqlite3_exec(db, query.c_str(), 0, 0, 0);
+        };
+        wxStopWatch watch;
+        for (int i = 0; i < inserts; i++) {
+            insert(i);
+        }
+        report("insert", inserts, watch.Time());
+
+        watch.Start();
+        for (int i = 0; i < deletes; i++) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT id FROM alarms WHERE time = ?;", -1, &stmt, 0) == SQLITE_OK) {
+                std::string time = timeOf(i);
+                sqlite3_bind_text(stmt, 1, time.c_str(), -1, SQLITE_STATIC);
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                }
+            }
+            sqlite3_finalize(stmt);
+            std::string query = "DELETE FROM alarms WHERE time = '" + timeOf(i) + "';";
+            sqlite3_exec(db, query.c_str(), 0, 0, 0);
+        }
+        report("delete", deletes, watch.Time());
+
+        for (int i = 0; i < listed; i++) {
+            insert(i * 29);
+        }
+        watch.Start();
+        for (int i = 0; i < lists; i++) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "SELECT time, day FROM alarms ORDER BY time;", -1, &stmt, 0) == SQLITE_OK) {
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+        report("list", lists, watch.Time());
+        sqlite3_close(db);
+    }
+
+    printf("AlarmStore, indexed integer schema, cached statements:\n");
+    {
+        AlarmStore store;
+        store.Open(":memory:");
+        store.Upgrade();
+        std::vector<int> ids;
+        wxStopWatch watch;
+        for (int i = 0; i < inserts; i++) {
+            ids.push_back(store.InsertAlarm(i % (24 * 60), 1u << 1));
+        }
+        report("insert", inserts, watch.Time());
+
+        watch.Start();
+        for (int i = 0; i < deletes; i++) {
+            store.DeleteAlarm(ids[i]);
+        }
+        report("delete", deletes, watch.Time());
+
+        for (int i = 0; i < listed; i++) {
+            store.InsertAlarm(i * 29 % (24 * 60), 1u << 1);
+        }
+        watch.Start();
+        for (int i = 0; i < lists; i++) {
+            store.ForEachAlarmByTime([](int, int, unsigned) {});
+        }
+        report("list", lists, watch.Time());
+    }
+
+    printf("Adding one alarm to 50000 listed, reload vs change feed:\n");
+    {
+        AlarmStore store;
+        store.Open(":memory:");
+        store.Upgrade();
+        store.Begin();
+        for (int i = 0; i < 50000; i++) {
+            store.InsertAlarm(i % (24 * 60), 1u << (i % 7));
+        }
+        store.Commit();
+        store.DiscardChanges();
+
+        std::vector<std::tuple<int, unsigned, int>> rows;
+        wxStopWatch watch;
+        store.InsertAlarm(12 * 60, kEveryDayMask);
+        store.ForEachAlarmByTime([&](int id, int minuteOfDay, unsigned dayMask) {
+            rows.emplace_back(minuteOfDay, dayMask, id);
+        });
+        printf("  reload   %7zu rows in %5ld us\n", rows.size(), (long)watch.TimeInMicro().ToLong());
+
+        store.DiscardChanges();
+        watch.Start();
+        store.InsertAlarm(12 * 60, kEveryDayMask);
+        store.DrainChanges([&](const AlarmChange& change) {
+            auto key = std::make_tuple(change.minuteOfDay, change.dayMask, change.id);
+            rows.insert(std::lower_bound(rows.begin(), rows.end(), key), key);
+        });
+        printf("  feed     %7d row  in %5ld us\n", 1, (long)watch.TimeInMicro().ToLong());
+    }
+
+    // Through the VFS, so page reads and writes are what gets encrypted
+    for (bool encrypt : {false, true}) {
+        printf(encrypt ? "On disk, AES-256-GCM page VFS:\n" : "On disk, default VFS:\n");
+        unsigned char key[EncryptedVfs::kKeySize] = {};
+        std::string path = wxFileName::CreateTempFileName("alarm-bench").ToStdString();
+        remove(path.c_str());
+        const int scans = 200;
+
+        AlarmStore store;
+        store.Open(path.c_str(), encrypt ? key : nullptr);
+        store.Upgrade();
+        std::vector<int> ids;
+        wxStopWatch watch;
+        for (int i = 0; i < inserts; i++) {
+            ids.push_back(store.InsertAlarm(i % (24 * 60), 1u << (i % 7)));
+        }
+        report("insert", inserts, watch.Time());
+
+        watch.Start();
+        for (int i = 0; i < deletes; i += 2) {
+            store.DeleteAlarm(ids[i]);
+        }
+        report("delete", deletes / 2, watch.Time());
+
+        // Reopening starts with a cold page cache, so every page is read and decrypted
+        watch.Start();
+        for (int i = 0; i < scans; i++) {
+            store.Close();
+            store.Open(path.c_str(), encrypt ? key : nullptr);
+            store.ForEachAlarm([](int, int, unsigned, const char*, const char*) {});
+        }
+        report("scan", scans, watch.Time());
+        store.Close();
+        EncryptedVfs::RemoveKey(path.c_str());
+        remove(path.c_str());
+    }
+
+    printf("AlarmTransfer, CSV:\n");
+    {
+        const int imports = 100000;
+        FILE* csv = tmpfile();
+        if (!csv) {
+            return;
+        }
+        fputs("time,day,recurrence\n", csv);
+        for (int i = 0; i < imports; i++) {
+            fprintf(csv, i % 10 ? "%s,\"%s\",\n" : "%s,\"%s\",FREQ=WEEKLY;INTERVAL=2;BYDAY=MO\n",
+                    timeOf(i).c_str(), kDayNames[i % 7]);
+        }
+        rewind(csv);
+
+        AlarmStore store;
+        store.Open(":memory:");
+        store.Upgrade();
+        AlarmTransfer::Result result;
+        wxStopWatch watch;
+        AlarmTransfer::ImportCsv(csv, store, nullptr, &result);
+        report("import", result.imported, watch.Time());
+
+        rewind(csv);
+        watch.Start();
+        AlarmTransfer::ExportCsv(csv, store);
+        report("export", result.imported, watch.Time());
+        fclose(csv);
+    }
+
+    printf("Startup with 1000000 alarms, encrypted database vs snapshot:\n");
+    {
+        const int alarms = 1000000;
+        unsigned char key[EncryptedVfs::kKeySize] = {};
+        std::string path = wxFileName::CreateTempFileName("alarm-bench").ToStdString();
+        std::string snapshotPath = path + ".snapshot";
+        remove(path.c_str());
+
+        AlarmStore store;
+        store.Open(path.c_str(), key);
+        store.Upgrade();
+        store.Begin();
+        for (int i = 0; i < alarms; i++) {
+            store.InsertAlarm(i % (24 * 60), 1u << (i % 7), i % 10 ? nullptr : "FREQ=DAILY;INTERVAL=2");
+        }
+        store.Commit();
+        AlarmSnapshot snapshot;
+        snapshot.Collect(store);
+        store.Close();
+        snapshot.Save(snapshotPath.c_str(), path.c_str(), key);
+
+        size_t read = 0;
+        wxStopWatch watch;
+        store.Open(path.c_str(), key);
+        store.ForEachAlarmByTime([&](int, int, unsigned) { read++; });
+        report("database", (int)read, watch.Time());
+        store.Close();
+
+        read = 0;
+        watch.Start();
+        if (snapshot.Load(snapshotPath.c_str(), path.c_str(), key)) {
+            snapshot.ForEachAlarm([&](int, int, unsigned, const char*, const char*) { read++; });
+        }
+        report("snapshot", (int)read, watch.Time());
+        EncryptedVfs::RemoveKey(path.c_str());
+        remove(snapshotPath.c_str());
+        remove(path.c_str());
+    }
+
+    // What each keystroke in the search box costs, at its widest
+    printf("Label search in 100000 alarms, matches found:\n");
+    {
+        const char* const words[] = {"work", "gym", "meds", "school", "pickup", "call", "dentist", "standup"};
+        std::string path = wxFileName::CreateTempFileName("alarm-bench").ToStdString();
+        remove(path.c_str());
+
+        AlarmStore store;
+        store.Open(path.c_str());
+        store.Upgrade();
+        store.Begin();
+        for (int i = 0; i < 100000; i++) {
+            std::string label = std::string(words[i % 8]) + " " + words[i / 8 % 8] + " " + std::to_string(i % 1000);
+            store.InsertAlarm(i % (24 * 60), 1u << (i % 7), nullptr, label);
+        }
+        store.Commit();
+
+        for (const char* typed : {"w", "wo", "work", "work g", "work gym 12"}) {
+            std::vector<int> ids;
+            wxStopWatch watch;
+            store.BeginLabelSearch(typed);
+            while (store.NextLabelMatches(&ids, 256)) {
+            }
+            report(typed, (int)ids.size(), watch.Time());
+        }
+        store.Close();
+        remove(path.c_str());
+    }
+
+    // Every page is decrypted under the old key and encrypted under the new
+    printf("Rotating the database key, alarms re-encrypted:\n");
+    for (int alarms : {10000, 100000, 1000000}) {
+        unsigned char keys[2][EncryptedVfs::kKeySize] = {{1}, {2}};
+        std::string path = wxFileName::CreateTempFileName("alarm-bench").ToStdString();
+        remove(path.c_str());
+
+        AlarmStore store;
+        store.Open(path.c_str(), keys[0]);
+        store.Upgrade();
+        store.Begin();
+        for (int i = 0; i < alarms; i++) {
+            store.InsertAlarm(i % (24 * 60), 1u << (i % 7));
+        }
+        store.Commit();
+        sqlite3_wal_checkpoint_v2(store.Handle(), "main", SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+
+        for (int threads : {1, 0}) {
+            EncryptedVfs::Rekeyer rekeyer(store.Handle(), threads);
+            EncryptedVfs::SetKey(path.c_str(), keys[1], keys[0]);
+            wxStopWatch watch;
+            int64_t cursor = 0;
+            while (cursor < rekeyer.PageCount()) {
+                if (!rekeyer.Step(&cursor)) {
+                    break;
+                }
+            }
+            char label[16];
+            snprintf(label, sizeof(label), "%d thr", rekeyer.Threads());
+            report(label, alarms, watch.Time());
+            std::swap(keys[0], keys[1]);
+        }
+        store.Close();
+        EncryptedVfs::RemoveKey(path.c_str());
+        remove(path.c_str());
+    }
+}
+
+// Small always-on-top window for an alarm, used where the desktop has no
+// notification service. It never runs a modal loop; `done` is told
+// whether the user snoozed or dismissed it.
+class AlarmPopup : public wxFrame {
+public:
+    AlarmPopup(wxWindow* parent, std::function<void(bool snooze)> done)
+        : wxFrame(parent, wxID_ANY, _("Alarm"), wxDefaultPosition, wxDefaultSize,
+                  wxDEFAULT_FRAME_STYLE | wxSTAY_ON_TOP), done(std::move(done)) {
+        panel = new wxPanel(this);
+        wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+        message = new wxStaticText(panel, wxID_ANY, "");
+        sizer->Add(message, 1, wxEXPAND | wxALL, 15);
+
+        wxBoxSizer* buttons = new wxBoxSizer(wxHORIZONTAL);
+        buttons->Add(new wxButton(panel, ID_SNOOZE, _("Snooze 5 Minutes")), 0, wxALL, 5);
+        buttons->Add(new wxButton(panel, wxID_CLOSE, _("Dismiss")), 0, wxALL, 5);
+        sizer->Add(buttons, 0, wxALIGN_CENTER | wxBOTTOM, 10);
+        panel->SetSizer(sizer);
+
+        Bind(wxEVT_BUTTON, [this](wxCommandEvent& event) {
+            this->done(event.GetId() == ID_SNOOZE);
+        });
+        // Closing it counts as dismissing; it is kept for the next alarm
+        Bind(wxEVT_CLOSE_WINDOW, [this](wxCloseEvent& event) {
+            if (!event.CanVeto()) {
+                event.Skip();
+                return;
+            }
+            event.Veto();
+            this->done(false);
+        });
+    }
+
+    void SetContent(const wxString& title, const wxString& text) {
+        SetTitle(title);
+        message->SetLabel(text);
+        panel->Layout();
+        Fit();
+    }
+
+private:
+    wxPanel* panel;
+    wxStaticText* message;
+    std::function<void(bool snooze)> done;
+};
+
+#if wxUSE_NOTIFICATION_MESSAGE && wxCHECK_VERSION(3, 1, 0) && defined(__WXGTK__)
+#define ALARM_DESKTOP_NOTIFICATIONS
+#endif
+
+// Shows alarms without blocking in a modal loop, so nothing waits on the
+// user: the sound starts as soon as an alarm is posted. Alarms of the same
+// minute share one notification and later ones queue behind it; each
+// offers Snooze and Dismiss. With a session bus the desktop's notification
+// service shows them (wxNotificationMessage, through libnotify on GTK),
+// otherwise an AlarmPopup does.
+class NotificationCenter {
+public:
+    NotificationCenter(wxWindow* owner, std::function<void()> playSound, std::function<void()> snooze)
+        : owner(owner), playSound(std::move(playSound)), snooze(std::move(snooze)) {}
+
+    ~NotificationCenter() {
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+        if (desktop) {
+            desktop->Close();
+        }
+#endif
+    }
+
+    // `minute` is the local minute the alarm is for
+    void Post(int64_t minute, const wxString& message) {
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+        // Never from one of their own handlers, so safe to delete here
+        retired.clear();
+#endif
+        bool coalesced = !queue.empty() && queue.back().minute == minute;
+        if (coalesced) {
+            queue.back().messages.push_back(message);
+        } else {
+            queue.push_back({minute, {message}});
+            playSound();
+        }
+        // Only the front one is on screen
+        if (queue.size() == 1) {
+            Show();
+        }
+    }
+
+private:
+    struct Notification {
+        int64_t minute;
+        std::vector<wxString> messages;
+    };
+
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+    static bool HaveSessionBus() {
+        wxString runtimeDir;
+        return wxGetEnv("DBUS_SESSION_BUS_ADDRESS", nullptr) ||
+               (wxGetEnv("XDG_RUNTIME_DIR", &runtimeDir) && wxFileExists(runtimeDir + "/bus"));
+    }
+#endif
+
+    void Show() {
+        const Notification& front = queue.front();
+        wxString title = front.messages.size() > 1
+            ? wxString::Format(_("%d alarms"), (int)front.messages.size()) : _("Alarm");
+        wxString text;
+        for (const wxString& message : front.messages) {
+            text += (text.empty() ? "" : "\n\n") + message;
+        }
+
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+        // A service that fails once is not tried again; the popup takes over
+        if (!desktopFailed && HaveSessionBus() && ShowOnDesktop(title, text)) {
+            return;
+        }
+#endif
+        if (!popup) {
+            popup = new AlarmPopup(owner, [this](bool snoozed) {
+                Finish(snoozed);
+            });
+        }
+        popup->SetContent(title, text);
+        popup->Show();
+        popup->Raise();
+    }
+
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+    // Each showing gets a notification of its own. The service reports a
+    // close after an action too, and may do so late, so only events from
+    // the notification of the current showing count.
+    bool ShowOnDesktop(const wxString& title, const wxString& text) {
+        std::unique_ptr<wxNotificationMessage> shown(new wxNotificationMessage(title, text, owner));
+        int showing = ++desktopShowing;
+        auto finish = [this, showing](bool snoozed) {
+            if (showing == desktopShowing) {
+                desktopShowing++;
+                Finish(snoozed);
+            }
+        };
+        shown->AddAction(ID_SNOOZE, _("Snooze 5 Minutes"));
+        shown->AddAction(wxID_CLOSE, _("Dismiss"));
+        shown->Bind(wxEVT_NOTIFICATION_MESSAGE_ACTION, [finish](wxCommandEvent& event) {
+            finish(event.GetId() == ID_SNOOZE);
+        });
+        shown->Bind(wxEVT_NOTIFICATION_MESSAGE_DISMISSED, [finish](wxCommandEvent&) {
+            finish(false);
+        });
+        shown->Bind(wxEVT_NOTIFICATION_MESSAGE_CLICK, [finish](wxCommandEvent&) {
+            finish(false);
+        });
+        if (desktop) {
+            desktop->Close();
+            retired.push_back(std::move(desktop));
+        }
+        if (!shown->Show(wxNotificationMessage::Timeout_Never)) {
+            desktopFailed = true;
+            retired.push_back(std::move(shown));
+            return false;
+        }
+        desktop = std::move(shown);
+        return true;
+    }
+#endif
+
+    void Finish(bool snoozed) {
+        if (queue.empty()) {
+            return;
+        }
+        queue.pop_front();
+        if (snoozed) {
+            snooze();
+        }
+        if (!queue.empty()) {
+            Show();
+        } else if (popup) {
+            popup->Hide();
+        }
+    }
+
+    wxWindow* owner;
+    std::function<void()> playSound;
+    std::function<void()> snooze;
+    std::deque<Notification> queue; // The front one is on screen
+    AlarmPopup* popup = nullptr;     // Owned by `owner`
+#ifdef ALARM_DESKTOP_NOTIFICATIONS
+    std::unique_ptr<wxNotificationMessage> desktop; // The latest one shown
+    std::vector<std::unique_ptr<wxNotificationMessage>> retired;
+    int desktopShowing = 0;
+    bool desktopFailed = false;
+#endif
+};
+
+// Draws the current time itself instead of being a wxStaticText, whose
+// SetLabel can re-measure, re-layout and repaint the whole panel. Nothing
+// happens unless the text changes, and then only this window is repainted;
+// when only the seconds changed, only their rectangle is. The parent's
+// background is drawn underneath by `drawBackground`, given this window's
+// position in the parent.
+class ClockWidget : public wxWindow {
+public:
+    typedef std::function<void(wxDC& dc, const wxPoint& origin)> BackgroundPainter;
+
+    ClockWidget(wxWindow* parent, BackgroundPainter drawBackground)
+        : wxWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE),
+          drawBackground(std::move(drawBackground)) {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, &ClockWidget::OnPaint, this);
+    }
+
+    // `seconds` is drawn after `text`, e.g. ":05", or empty to hide them
+    void SetTime(const wxString& text, const wxString& seconds) {
+        if (text == this->text && seconds == this->seconds) {
+            return;
+        }
+        bool onlySeconds = text == this->text && !seconds.empty() && !this->seconds.empty();
+        this->text = text;
+        this->seconds = seconds;
+
+        // Digits all take about the same width, so the best size only
+        // changes with the wording or the seconds being shown or hidden
+        wxString shape = Shape(text + seconds);
+        if (shape != this->shape) {
+            this->shape = shape;
+            InvalidateBestSize();
+            if (GetParent()) {
+                GetParent()->Layout();
+            }
+        }
+        if (onlySeconds && GetLayoutDirection() != wxLayout_RightToLeft) {
+            RefreshRect(SecondsRect());
+        } else {
+            Refresh();
+        }
+    }
+
+protected:
+    wxSize DoGetBestSize() const override {
+        wxSize size = GetTextExtent(shape.empty() ? wxString("00:00") : shape);
+        return wxSize(size.x + FromDIP(4), size.y);
+    }
+
+private:
+    static wxString Shape(const wxString& text) {
+        wxString shape = text;
+        for (size_t i = 0; i < shape.length(); i++) {
+            if (shape[i] >= '0' && shape[i] <= '9') {
+                shape[i] = '0';
+            }
+        }
+        return shape;
+    }
+
+    // Where `text` starts, centred as a whole with the seconds
+    int TextLeft() const {
+        return (GetClientSize().x - GetTextExtent(text + seconds).x) / 2;
+    }
+
+    wxRect SecondsRect() const {
+        wxSize size = GetClientSize();
+        int left = TextLeft() + GetTextExtent(text).x;
+        return wxRect(left, 0, std::max(GetTextExtent(Shape(seconds)).x, GetTextExtent(seconds).x) + FromDIP(2),
+                      size.y);
+    }
+
+    void OnPaint(wxPaintEvent& event) {
+        wxBufferedPaintDC dc(this);
+        drawBackground(dc, GetPosition());
+        dc.SetFont(GetFont());
+        dc.SetTextForeground(GetForegroundColour());
+        dc.SetBackgroundMode(wxTRANSPARENT);
+        int top = (GetClientSize().y - GetTextExtent(text).y) / 2;
+        dc.DrawText(text + seconds, TextLeft(), top);
+    }
+
+    BackgroundPainter drawBackground;
+    wxString text;
+    wxString seconds;
+    wxString shape; // text + seconds with every digit a 0
+};
+
+// Report list that owns no items: the frame keeps the rows and `cellText`
+// formats a cell only when it is painted, so the cost of the control
+// doesn't grow with the number of alarms
+class AlarmListCtrl : public wxListCtrl {
+public:
+    typedef std::function<wxString(long row, long column)> CellText;
+
+    AlarmListCtrl(wxWindow* parent, CellText cellText)
+        : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+                     wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL),
+          cellText(std::move(cellText)) {}
+
+protected:
+    wxString OnGetItemText(long item, long column) const override {
+        return cellText(item, column);
+    }
+
+private:
+    CellText cellText;
+};
+
+// How many alarms ring in each minute of one week, from a Monday: an
+// alarm at 07:30 on weekdays counts once in each of five minutes. An
+// alarm with a rule counts only on the days it falls on that week, so one
+// every other week or once a month isn't counted every week. The frame
+// adds and takes away alarms as the list does, so the counts are only
+// rebuilt from the alarms when the week changes.
+class WeekOccupancy {
+public:
+    static const int kDayMinutes = 24 * 60;
+
+    WeekOccupancy() : counts(7 * kDayMinutes) {}
+
+    // Empties the counts, for the week starting on `monday` (days since the epoch)
+    void Clear(int32_t monday) {
+        std::fill(counts.begin(), counts.end(), 0);
+        this->monday = monday;
+    }
+
+    int32_t Monday() const {
+        return monday;
+    }
+
+    // The days of the week (tm_wday bits) an alarm rings on; `rule` is
+    // null for a plain weekly alarm
+    unsigned DaysRinging(unsigned dayMask, const RecurrenceRule* rule) const {
+        if (!rule) {
+            return dayMask & kEveryDayMask;
+        }
+        unsigned days = 0;
+        for (int32_t day = rule->NextDay(monday); day < monday + 7; day = rule->NextDay(day + 1)) {
+            days |= 1u << WeekdayFromDays(day);
+        }
+        return days;
+    }
+
+    // `delta` is 1 for an alarm added, -1 for one taken away, with the
+    // same days it was added with
+    void Add(int minuteOfDay, unsigned dayMask, int delta) {
+        if (minuteOfDay < 0 || minuteOfDay >= kDayMinutes) {
+            return;
+        }
+        for (int day = 0; day < 7; day++) {
+            if (dayMask & (1u << day)) {
+                counts[day * kDayMinutes + minuteOfDay] += delta;
+            }
+        }
+    }
+
+    // The minutes of `day` (tm_wday order) from `minuteOfDay` on
+    const int* Day(int day, int minuteOfDay = 0) const {
+        return counts.data() + day * kDayMinutes + minuteOfDay;
+    }
+
+private:
+    std::vector<int> counts; // Signed, so a mismatched removal shows up as negative rather than wrapping
+    int32_t monday = 0;
+};
+
+// Draws a WeekOccupancy as a heatmap, a row per day from Monday and a
+// column per cell of some minutes. The mouse wheel zooms from hours down
+// to single minutes around the pointer, Shift+wheel scrolls through the
+// day, and hovering a cell shows its count. A paint sums the minutes in
+// view into cells in one pass, at most the week's 10,080, writes a pixel
+// per cell and scales the image up; its cost doesn't depend on the
+// number of alarms.
+class WeekView : public wxWindow {
+public:
+    WeekView(wxWindow* parent, const WeekOccupancy& occupancy)
+        : wxWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE),
+          occupancy(occupancy) {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        SetBackgroundColour(wxColour(250, 250, 255));
+        Bind(wxEVT_PAINT, &WeekView::OnPaint, this);
+        Bind(wxEVT_SIZE, [this](wxSizeEvent& event) {
+            Refresh();
+            event.Skip();
+        });
+        Bind(wxEVT_MOUSEWHEEL, &WeekView::OnMouseWheel, this);
+        Bind(wxEVT_MOTION, &WeekView::OnMotion, this);
+    }
+
+protected:
+    wxSize DoGetBestSize() const override {
+        return FromDIP(wxSize(720, 240));
+    }
+
+private:
+    // Minutes per cell, from the whole-day view in
+    static constexpr int kZooms[] = {60, 30, 15, 5, 1};
+    static const int kMinCellWidth = 6; // In DIPs, so single minutes stay visible
+
+    // Where the cells go and how many fit, for the current size and zoom
+    struct Grid {
+        wxRect area;
+        int columns;
+        int cellWidth;
+        int cellHeight;
+    };
+
+    Grid CellGrid() const {
+        wxSize size = GetClientSize();
+        int dayWidth = 0;
+        for (int day = 0; day < 7; day++) {
+            dayWidth = std::max(dayWidth, GetTextExtent(wxGetTranslation(kDayNames[day])).x);
+        }
+        int margin = FromDIP(6);
+        Grid grid;
+        grid.area = wxRect(dayWidth + 2 * margin, GetCharHeight() + 2 * margin, 0, 0);
+        grid.area.width = std::max(1, size.x - grid.area.x - margin);
+        grid.area.height = std::max(7, size.y - grid.area.y - margin);
+        int minutes = kZooms[zoom];
+        grid.columns = std::max(1, std::min(WeekOccupancy::kDayMinutes / minutes,
+                                            grid.area.width / FromDIP(kMinCellWidth)));
+        grid.cellWidth = std::max(1, grid.area.width / grid.columns);
+        grid.cellHeight = grid.area.height / 7;
+        return grid;
+    }
+
+    // Keeps the view inside the day, starting on a cell boundary
+    void SetFirstMinute(int minute, const Grid& grid) {
+        int minutes = kZooms[zoom];
+        int last = WeekOccupancy::kDayMinutes - grid.columns * minutes;
+        firstMinute = std::max(0, std::min(last, minute / minutes * minutes));
+    }
+
+    static wxString FormatMinute(int minuteOfDay) {
+        return wxString::Format("%02d:%02d", minuteOfDay / 60, minuteOfDay % 60);
+    }
+
+    void OnPaint(wxPaintEvent& event) {
+        wxStopWatch watch;
+        wxBufferedPaintDC dc(this);
+        dc.SetBackground(wxBrush(GetBackgroundColour()));
+        dc.Clear();
+        Grid grid = CellGrid();
+        SetFirstMinute(firstMinute, grid);
+        int minutes = kZooms[zoom];
+
+        // The one pass: every minute in view into its cell
+        std::vector<int> cells(7 * grid.columns);
+        int peak = 0;
+        for (int row = 0; row < 7; row++) {
+            const int* counts = occupancy.Day((row + 1) % 7, firstMinute);
+            for (int column = 0; column < grid.columns; column++) {
+                int sum = 0;
+                for (int minute = 0; minute < minutes; minute++) {
+                    sum += *counts++;
+                }
+                cells[row * grid.columns + column] = sum;
+                peak = std::max(peak, sum);
+            }
+        }
+
+        // Empty cells take the background; the rest run from pale to deep blue
+        wxImage image(grid.columns, 7);
+        unsigned char* pixel = image.GetData();
+        wxColour empty = GetBackgroundColour();
+        for (int count : cells) {
+            double level = count > 0 ? (double)count / peak : 0;
+            pixel[0] = count > 0 ? (unsigned char)(200 - 200 * level) : empty.Red();
+            pixel[1] = count > 0 ? (unsigned char)(220 - 150 * level) : empty.Green();
+            pixel[2] = count > 0 ? (unsigned char)(255 - 85 * level) : empty.Blue();
+            pixel += 3;
+        }
+        image.Rescale(grid.columns * grid.cellWidth, 7 * grid.cellHeight, wxIMAGE_QUALITY_NORMAL);
+        dc.DrawBitmap(wxBitmap(image), grid.area.x, grid.area.y);
+
+        dc.SetFont(GetFont());
+        dc.SetTextForeground(wxColour(50, 50, 100));
+        dc.SetPen(wxPen(GetBackgroundColour()));
+        for (int row = 0; row < 7; row++) {
+            int top = grid.area.y + row * grid.cellHeight;
+            if (row > 0) {
+                dc.DrawLine(grid.area.x, top, grid.area.x + grid.columns * grid.cellWidth, top);
+            }
+            dc.DrawText(wxGetTranslation(kDayNames[(row + 1) % 7]), FromDIP(6),
+                        top + (grid.cellHeight - GetCharHeight()) / 2);
+        }
+        // A time over every few columns, as often as the labels fit
+        int labelWidth = GetTextExtent("00:00").x + FromDIP(8);
+        int step = (labelWidth + grid.cellWidth - 1) / grid.cellWidth;
+        for (int column = 0; column < grid.columns; column += step) {
+            dc.DrawText(FormatMinute(firstMinute + column * minutes),
+                        grid.area.x + column * grid.cellWidth, FromDIP(6));
+        }
+        wxLogTrace(TRACE_TIMING, "Drew the week view (%d x 7 cells) in %lld us", grid.columns,
+                   (long long)watch.TimeInMicro().GetValue());
+    }
+
+    // The cell under `point`, as (day in tm_wday order, first minute), or false
+    bool CellAt(const wxPoint& point, const Grid& grid, int* day, int* minuteOfDay) const {
+        int column = (point.x - grid.area.x) / grid.cellWidth;
+        int row = (point.y - grid.area.y) / std::max(1, grid.cellHeight);
+        if (point.x < grid.area.x || point.y < grid.area.y || column >= grid.columns || row >= 7) {
+            return false;
+        }
+        *day = (row + 1) % 7;
+        *minuteOfDay = firstMinute + column * kZooms[zoom];
+        return true;
+    }
+
+    // Zooms keeping the minute under the pointer where it is
+    void OnMouseWheel(wxMouseEvent& event) {
+        Grid grid = CellGrid();
+        int steps = event.GetWheelRotation() / std::max(1, event.GetWheelDelta());
+        if (steps == 0) {
+            return;
+        }
+        if (event.ShiftDown() || event.GetWheelAxis() == wxMOUSE_WHEEL_HORIZONTAL) {
+            SetFirstMinute(firstMinute - steps * std::max(1, grid.columns / 4) * kZooms[zoom], grid);
+        } else {
+            int x = std::max(0, std::min(event.GetX() - grid.area.x, grid.columns * grid.cellWidth - 1));
+            int pointed = firstMinute + x / grid.cellWidth * kZooms[zoom];
+            int next = std::max(0, std::min((int)WXSIZEOF(kZooms) - 1, zoom + steps));
+            if (next == zoom) {
+                return;
+            }
+            zoom = next;
+            grid = CellGrid();
+            SetFirstMinute(pointed - x / grid.cellWidth * kZooms[zoom], grid);
+        }
+        Refresh();
+    }
+
+    void OnMotion(wxMouseEvent& event) {
+        Grid grid = CellGrid();
+        int day, minuteOfDay;
+        if (!CellAt(event.GetPosition(), grid, &day, &minuteOfDay)) {
+            UnsetToolTip();
+            return;
+        }
+        int count = 0;
+        const int* counts = occupancy.Day(day, minuteOfDay);
+        for (int minute = 0; minute < kZooms[zoom]; minute++) {
+            count += counts[minute];
+        }
+        wxString when = FormatMinute(minuteOfDay);
+        if (kZooms[zoom] > 1) {
+            when += "-" + FormatMinute(minuteOfDay + kZooms[zoom] - 1);
+        }
+        SetToolTip(wxString::Format(_("%s %s: %d alarms"), wxGetTranslation(kDayNames[day]), when, count));
+    }
+
+    const WeekOccupancy& occupancy;
+    int zoom = 0;        // Index into kZooms
+    int firstMinute = 0; // Of the day, at the left edge
+};
+
+// Every translation under locale/, loaded once at startup so switching
+// language never reads a .mo file: each language keeps its catalog in a
+// wxTranslations of its own, and switching installs that one as the
+// active catalog. English is the language of the source strings and has
+// no catalog.
+class LanguageCatalogs {
+public:
+    ~LanguageCatalogs() {
+        if (switched) {
+            wxTranslations::SetNonOwned(original);
+        }
+    }
+
+    // Loads <dir>/<code>/LC_MESSAGES/<domain>.mo for every <code> in `dir`
+    void Load(const wxString& dir, const wxString& domain) {
+        wxFileTranslationsLoader::AddCatalogLookupPathPrefix(dir);
+        wxDir languages(dir);
+        wxString code;
+        bool more = languages.IsOpened() && languages.GetFirst(&code, "", wxDIR_DIRS);
+        for (; more; more = languages.GetNext(&code)) {
+            const wxLanguageInfo* info = wxLocale::FindLanguageInfo(code);
+            if (!info) {
+                continue;
+            }
+            std::unique_ptr<wxTranslations> translations(new wxTranslations);
+            translations->SetLanguage((wxLanguage)info->Language);
+            if (translations->AddCatalog(domain)) {
+                catalogs[(wxLanguage)info->Language] = std::move(translations);
+            }
+        }
+    }
+
+    // False, leaving the active catalog as it was, if `language` has none
+    bool Activate(wxLanguage language) {
+        wxTranslations* translations = nullptr;
+        if (language != wxLANGUAGE_ENGLISH) {
+            auto found = catalogs.find(language);
+            if (found == catalogs.end()) {
+                return false;
+            }
+            translations = found->second.get();
+        }
+        if (!switched) {
+            original = wxTranslations::Get(); // wxLocale's, which it still owns
+            switched = true;
+        }
+        wxTranslations::SetNonOwned(translations);
+        return true;
+    }
+
+private:
+    std::map<wxLanguage, std::unique_ptr<wxTranslations>> catalogs;
+    wxTranslations* original = nullptr;
+    bool switched = false;
+};
+
 class AlarmFrame : public wxFrame {
 public:
     AlarmFrame(const wxString& title);
@@ -165,10 +3947,42 @@ public:
 private:
     void OnSetAlarm(wxCommandEvent& event);
     void OnDeleteAlarm(wxCommandEvent& event);
-    void OnCheckAlarm(wxTimerEvent& event);
+    void OnAlarmsDue(wxThreadEvent& event);
+    void OnTimeZoneChanged(wxThreadEvent& event);
+    void OnMeasureJitter(wxCommandEvent& event);
+    void OnWheelTimer(wxTimerEvent& event);
+    void OnStartCountdown(wxCommandEvent& event);
+    void OnCancelTimers(wxCommandEvent& event);
+    void OnImportAlarms(wxCommandEvent& event);
+    void OnExportAlarms(wxCommandEvent& event);
+    void OnWeekView(wxCommandEvent& event);
     void OnClose(wxCloseEvent& event);
-    void RefreshAlarmList();
+    void RefreshAlarmList(const AlarmSnapshot* snapshot = nullptr);
+    void ApplyAlarmChange(const AlarmChange& change);
+    void OnDatabaseWritten(wxThreadEvent& event);
+    void OnKeyRotationProgress(wxThreadEvent& event);
+    void OnImportProgress(wxThreadEvent& event);
+    void OnImportFinished(wxThreadEvent& event);
+    void OnPaintBackground(wxPaintEvent& event);
+    bool UpdateBackgroundCache();
+    void RenderBackground(const wxSize& size, double scale);
+    void OnShowSeconds(wxCommandEvent& event);
+    void UpdateClock();
+    void ArmClockTimer();
+    void InsertAlarmRow(int id, int minuteOfDay, unsigned dayMask, const std::string& label,
+                        const RecurrenceRule& rule);
+    unsigned WeekDaysRinging(int id, unsigned dayMask) const;
+    void RebuildOccupancy();
+    void UpdateOccupancyWeek(time_t now);
+    void RemoveAlarmRow(int id);
+    wxString AlarmCellText(long row, long column);
+    void OnAlarmColumnClick(wxListEvent& event);
+    void SortAlarmRows(bool reverse);
+    void OnAlarmFilterChanged(wxCommandEvent& event);
+    void FilterAlarmRows(bool searchAgain = false);
+    void ContinueLabelSearch(int generation);
     void OnIconize(wxIconizeEvent& event);
+    void OnShow(wxShowEvent& event);
     void OnLanguageChange(wxCommandEvent& event);
     void RefreshUI();
     void OnSoundSettings(wxCommandEvent& event);
@@ -179,11 +3993,89 @@ private:
     ~AlarmFrame();
 
     wxTextCtrl* alarmTimeInput;
+    wxTextCtrl* labelInput;
     wxListCtrl* alarmList;
     wxTimer* timer;
-    sqlite3* db;
+    wxTimer* wheelTimer;
+    NotificationCenter* notifications;
+    SchedulerThread* schedulerThread;
+    LocalTimeZone zone;
+    std::vector<std::pair<double, double>> jitterSamples; // Probe lateness (thread, GUI) in ms
+    int jitterProbesExpected = 0;
+    TimingWheel wheel;
+    std::unordered_map<TimingWheel::Handle, wxString> oneShotMessages;
+    AlarmStore store;         // Reads only
+    DatabaseWriter* databaseWriter = nullptr; // Every write
+    wxProgressDialog* importProgress = nullptr; // While an import runs
+    std::shared_ptr<std::atomic<bool>> importCancel;
+    DatabaseKey databaseKey;
+    std::string resumeKeyPassword; // Until a rotation cut short is handed to the writer
+    AlarmSnapshot snapshot;      // Loaded for startup, collected again on exit
+    bool snapshotCurrent = false; // alarms.snapshot matches alarms.db
+    // One (minuteOfDay, dayMask, id) per alarm list row, in row order
+    typedef std::tuple<int, unsigned, int> AlarmRowKey;
+    // The column the list is sorted on; the id breaks ties, so every row
+    // has exactly one place and can be found by binary search
+    struct AlarmRowOrder {
+        enum Column { Time, Day };
+        Column column = Time;
+        bool ascending = true;
+
+        bool operator()(const AlarmRowKey& a, const AlarmRowKey& b) const {
+            return ascending ? Key(a) < Key(b) : Key(b) < Key(a);
+        }
+
+        std::tuple<int, int, int> Key(const AlarmRowKey& row) const {
+            int day = DaySortKey(std::get<1>(row));
+            return column == Day ? std::make_tuple(day, std::get<0>(row), std::get<2>(row))
+                                 : std::make_tuple(std::get<0>(row), day, std::get<2>(row));
+        }
+    };
+    AlarmRowOrder alarmOrder;
+    std::vector<AlarmRowKey> alarmRows; // Every alarm
+    std::unordered_map<int, AlarmRowKey> alarmRowOfId;
+    std::unordered_map<int, wxString> alarmLabels; // By id, for the alarms that have one
+    std::unordered_map<int, RecurrenceRule> alarmRules; // By id, for the alarms with more than a day mask
+    WeekOccupancy occupancy;      // alarmRows by minute of this week
+    wxFrame* weekFrame = nullptr; // While the week view is open
+    WeekView* weekView = nullptr;
+    // What the list is narrowed to by the controls above it
+    struct AlarmFilter {
+        std::string words;                // Label search, each word a prefix
+        int fromMinute = 0;               // Time range, wrapping past
+        int toMinute = 24 * 60 - 1;       // midnight when from > to
+        unsigned dayMask = kEveryDayMask; // Alarms ringing on any of these days
+
+        bool Active() const {
+            return !words.empty() || fromMinute != 0 || toMinute != 24 * 60 - 1 || dayMask != kEveryDayMask;
+        }
+
+        // All but the words, which take the label index
+        bool Passes(const AlarmRowKey& row) const {
+            int minute = std::get<0>(row);
+            bool inRange = fromMinute <= toMinute ? minute >= fromMinute && minute <= toMinute
+                                                  : minute >= fromMinute || minute <= toMinute;
+            return inRange && (std::get<1>(row) & dayMask) != 0;
+        }
+    };
+    AlarmFilter alarmFilter;
+    std::vector<AlarmRowKey> shownRows;   // The rows passing alarmFilter, in alarmOrder
+    std::unordered_set<int> labelMatches; // Ids found by the label search so far
+    int labelSearchGeneration = 0;        // Bumped by each search, retiring the one before
+    static const int kLabelSearchSliceMs = 3; // Per event, so typing never waits on the index
+    // The rows the list shows, in row order
+    const std::vector<AlarmRowKey>& ListedRows() const {
+        return alarmFilter.Active() ? shownRows : alarmRows;
+    }
+    bool TakeAlarmSelection(AlarmRowKey* key);
+    void RestoreAlarmSelection(const AlarmRowKey& key);
+    wxSearchCtrl* searchInput;
+    wxTextCtrl* fromInput;
+    wxTextCtrl* toInput;
+    wxChoice* filterDayChoice;
     wxButton* deleteButton;
-    wxStaticText* currentTimeText;
+    ClockWidget* currentTimeText;
+    bool showSeconds = false;
     wxChoice* dayChoice;
     wxChoice* soundChoice;
     wxChoice* amPmChoice; // Add AM/PM choice
@@ -191,11 +4083,25 @@ private:
     AlarmTaskBarIcon* m_taskBarIcon;
     std::map<std::string, wxSound*> sounds;
     wxPanel* mainPanel;  // Add panel as member
+    // mainPanel's background as last rendered, and what it was rendered for
+    wxBitmap backgroundCache;
+    wxSize backgroundSize;
+    double backgroundScale = 0;
+    wxLayoutDirection backgroundDirection = wxLayout_Default;
 
     void InitializeDatabase();
-    void SaveAlarmToDatabase(const std::string& time, const std::string& day);
-    void DeleteAlarmFromDatabase(const std::string& time);
+    void SaveAlarmToDatabase(int minuteOfDay, unsigned dayMask, const wxString& label);
+    void DeleteAlarmFromDatabase(int id);
+    void LoadAlarmSchedule(const AlarmSnapshot* snapshot = nullptr);
+    bool ParseAlarm(int id, int minuteOfDay, unsigned dayMask,
+                    const char* recurrence, AlarmSpec* alarm);
+    TimingWheel::Handle StartOneShot(int seconds, const wxString& message);
+    void ArmWheelTimer();
+    void AdvanceWheel(int64_t now);
+    void ShowAlarm(const wxString& message);
+    void ShowJitterReport();
     std::string GetCurrentTime();
+    std::string FormatTime(time_t when);
     void UpdateCurrentTime(wxTimerEvent& event);
     void InitializeSounds();
     void PlayAlarmSound();
@@ -203,26 +4109,38 @@ private:
     std::string GetCurrentDayOfWeek();
     void CreateUI();
 
-    wxLocale m_locale;
+    // Switching language swaps catalogs and the tables below; nothing is
+    // read from disk or looked up per row
+    LanguageCatalogs catalogs;
+    wxLanguage language = wxLANGUAGE_ENGLISH;
+    wxString dayTexts[kEveryDayMask + 1]; // Each day mask as the list shows it
+    std::vector<wxString> minuteTexts;    // Each minute of the day, likewise
+    void TranslateListTexts();
+    void SetAlarmColumns();
 
     // Security related members and methods
     bool isLocked;
-    wxString hashedPassword;
+    PasswordHash passwordHash;
     void OnLockApp(wxCommandEvent& event);
     void OnUnlockApp(wxCommandEvent& event);
     void OnChangePassword(wxCommandEvent& event);
-    bool VerifyPassword(const wxString& password);
-    wxString HashPassword(const wxString& password);
+    void CheckPassword(const wxString& password, std::function<void(bool)> done);
     void LockInterface();
     void UnlockInterface();
     void InitializeSecurity();
 
+    // Slow work kept off the GUI thread, one task at a time
+    BackgroundTask* backgroundTask = nullptr;
+    std::queue<std::pair<std::function<void()>, std::function<void()>>> backgroundTasks; // (work, done)
+    void RunInBackground(std::function<void()> work, std::function<void()> done);
+    void StartBackgroundTask();
+    void OnBackgroundTaskDone(wxThreadEvent& event);
+
     // Secure database methods
-    void EncryptDatabase();
-    wxString SecureQuery(const wxString& query, const std::vector<wxString>& params);
+    void EncryptDatabase(const wxString& password, const PasswordHash& hash);
 
     // Time format settings
-    bool use24HourFormat;
+    bool use24HourFormat = true;
 };
 
 class AlarmTaskBarIcon : public wxTaskBarIcon {
@@ -268,7 +4186,25 @@ wxEND_EVENT_TABLE()
 
 wxIMPLEMENT_APP(AlarmApp);
 
+void AlarmApp::OnInitCmdLine(wxCmdLineParser& parser) {
+    wxApp::OnInitCmdLine(parser);
+    parser.AddSwitch("", "benchmark", "print database throughput figures and exit");
+}
+
+bool AlarmApp::OnCmdLineParsed(wxCmdLineParser& parser) {
+    runBenchmark = parser.Found("benchmark");
+    return wxApp::OnCmdLineParsed(parser);
+}
+
 bool AlarmApp::OnInit() {
+    if (!wxApp::OnInit()) {
+        return false;
+    }
+    if (runBenchmark) {
+        RunStoreBenchmark();
+        return false;
+    }
+
     // Create a professional-looking icon
     wxBitmap finalIcon(128, 128, 32);
     wxMemoryDC dc(finalIcon);
@@ -348,21 +4284,58 @@ AlarmFrame::AlarmFrame(const wxString& title)
     settingsMenu->AppendSeparator();
     settingsMenu->AppendCheckItem(ID_TIME_FORMAT, _("Use 24-hour format"));
     settingsMenu->Check(ID_TIME_FORMAT, true);  // Default to 24-hour
+    settingsMenu->AppendCheckItem(ID_SHOW_SECONDS, _("Show seconds"));
     menuBar->Append(settingsMenu, _("Settings"));
 
+    // Add Timers menu
+    wxMenu* timersMenu = new wxMenu;
+    timersMenu->Append(ID_START_COUNTDOWN, _("Start Countdown..."));
+    timersMenu->Append(ID_CANCEL_TIMERS, _("Cancel All Timers"));
+    timersMenu->AppendSeparator();
+    timersMenu->Append(ID_MEASURE_JITTER, _("Measure Alarm Jitter"));
+    menuBar->Append(timersMenu, _("Timers"));
+
+    // Create Alarms menu
+    wxMenu* alarmsMenu = new wxMenu;
+    alarmsMenu->Append(ID_IMPORT_ALARMS, _("Import Alarms..."));
+    alarmsMenu->Append(ID_EXPORT_ALARMS, _("Export Alarms..."));
+    alarmsMenu->AppendSeparator();
+    alarmsMenu->Append(ID_WEEK_VIEW, _("Week View"));
+    menuBar->Append(alarmsMenu, _("Alarms"));
+
     SetMenuBar(menuBar);
+    CreateStatusBar(); // Background work, e.g. re-encrypting after a password change
+
+    catalogs.Load("locale", "messages");
+    TranslateListTexts();
 
     // Initialize mainPanel
     mainPanel = new wxPanel(this, wxID_ANY);
     CreateUI();
 
-    // Timer Setup
-    timer = new wxTimer(this);
-    Bind(wxEVT_TIMER, &AlarmFrame::OnCheckAlarm, this);
-    Bind(wxEVT_TIMER, &AlarmFrame::UpdateCurrentTime, this);
-    timer->Start(1000); // Check every second
+    // Timer Setup: the clock ticks every second while visible, alarms are
+    // watched by the scheduler thread
+    timer = new wxTimer(this, ID_CLOCK_TIMER);
+    Bind(wxEVT_TIMER, &AlarmFrame::UpdateCurrentTime, this, ID_CLOCK_TIMER);
+    // Snoozes and countdowns live in the timing wheel, which only needs a
+    // wakeup when its next occupied slot comes due
+    wheelTimer = new wxTimer(this, ID_WHEEL_TIMER);
+    notifications = new NotificationCenter(this, [this] {
+        PlayAlarmSound();
+    }, [this] {
+        StartOneShot(5 * 60, _("⏰ Snoozed alarm: time to wake up!"));
+    });
+    Bind(wxEVT_TIMER, &AlarmFrame::OnWheelTimer, this, ID_WHEEL_TIMER);
+    ArmClockTimer();
+    Bind(EVT_ALARMS_DUE, &AlarmFrame::OnAlarmsDue, this);
+    Bind(EVT_TIME_ZONE_CHANGED, &AlarmFrame::OnTimeZoneChanged, this);
+    schedulerThread = new SchedulerThread(this, "alarms.fired");
+    if (schedulerThread->Run() != wxTHREAD_NO_ERROR) {
+        wxMessageBox(_("Failed to start the alarm scheduler!"), _("Error"), wxICON_ERROR);
+    }
 
     // Bind security events
+    Bind(EVT_BACKGROUND_TASK_DONE, &AlarmFrame::OnBackgroundTaskDone, this);
     Bind(wxEVT_MENU, &AlarmFrame::OnLockApp, this, ID_LOCK);
     Bind(wxEVT_MENU, &AlarmFrame::OnUnlockApp, this, ID_UNLOCK);
     Bind(wxEVT_MENU, &AlarmFrame::OnChangePassword, this, ID_CHANGE_PASSWORD);
@@ -372,6 +4345,15 @@ AlarmFrame::AlarmFrame(const wxString& title)
 
     // Bind time format event
     Bind(wxEVT_MENU, &AlarmFrame::OnTimeFormatChange, this, ID_TIME_FORMAT);
+    Bind(wxEVT_MENU, &AlarmFrame::OnShowSeconds, this, ID_SHOW_SECONDS);
+
+    // Bind timer events
+    Bind(wxEVT_MENU, &AlarmFrame::OnStartCountdown, this, ID_START_COUNTDOWN);
+    Bind(wxEVT_MENU, &AlarmFrame::OnCancelTimers, this, ID_CANCEL_TIMERS);
+    Bind(wxEVT_MENU, &AlarmFrame::OnMeasureJitter, this, ID_MEASURE_JITTER);
+    Bind(wxEVT_MENU, &AlarmFrame::OnImportAlarms, this, ID_IMPORT_ALARMS);
+    Bind(wxEVT_MENU, &AlarmFrame::OnExportAlarms, this, ID_EXPORT_ALARMS);
+    Bind(wxEVT_MENU, &AlarmFrame::OnWeekView, this, ID_WEEK_VIEW);
 
     // Initialize system tray icon
     m_taskBarIcon = new AlarmTaskBarIcon(this);
@@ -379,9 +4361,28 @@ AlarmFrame::AlarmFrame(const wxString& title)
     // Initialize sounds
     InitializeSounds();
 
-    InitializeDatabase();
     InitializeSecurity();
-    RefreshAlarmList();
+    InitializeDatabase();
+    Bind(EVT_DATABASE_WRITTEN, &AlarmFrame::OnDatabaseWritten, this);
+    Bind(EVT_KEY_ROTATION_PROGRESS, &AlarmFrame::OnKeyRotationProgress, this);
+    Bind(EVT_IMPORT_PROGRESS, &AlarmFrame::OnImportProgress, this);
+    Bind(EVT_IMPORT_FINISHED, &AlarmFrame::OnImportFinished, this);
+    databaseWriter = new DatabaseWriter(this, "alarms.db", "alarms.key", "alarms.snapshot", databaseKey);
+    if (databaseWriter->Run() != wxTHREAD_NO_ERROR) {
+        wxMessageBox(_("Failed to start the database writer!"), _("Error"), wxICON_ERROR);
+    }
+    if (databaseKey.Previous()) {
+        databaseWriter->ResumeKeyRotation(resumeKeyPassword);
+    }
+    OPENSSL_cleanse(&resumeKeyPassword[0], resumeKeyPassword.size());
+    resumeKeyPassword.clear();
+    store.DiscardChanges();
+    wxStopWatch startup;
+    RefreshAlarmList(snapshotCurrent ? &snapshot : nullptr);
+    LoadAlarmSchedule(snapshotCurrent ? &snapshot : nullptr);
+    wxLogTrace(TRACE_TIMING, "Alarms ready in %ld ms (%s)", startup.Time(),
+               snapshotCurrent ? "snapshot" : "database");
+    snapshot.Clear();
 
     // Set minimum size
     SetMinSize(wxSize(400, 300));
@@ -390,43 +4391,38 @@ AlarmFrame::AlarmFrame(const wxString& title)
     Centre();
 
     Bind(wxEVT_ICONIZE, &AlarmFrame::OnIconize, this);
+    Bind(wxEVT_SHOW, &AlarmFrame::OnShow, this);
 }
 
 void AlarmFrame::CreateUI() {
-    // Create a more attractive gradient background
-    wxColour startColor(190, 210, 255);  // Lighter blue
-    wxColour endColor(220, 230, 255);    // Very light blue
-    
+    // Gradient background, rendered once per size and blitted on paint
     mainPanel->SetBackgroundStyle(wxBG_STYLE_PAINT);
-    mainPanel->Bind(wxEVT_PAINT, [=](wxPaintEvent& evt) {
-        wxPaintDC dc(mainPanel);
-        wxRect rect = mainPanel->GetClientRect();
-        
-        // Create rounded rectangle background
-        wxGraphicsContext* gc = wxGraphicsContext::Create(dc);
-        if (gc) {
-            // Main gradient
-            gc->SetBrush(gc->CreateLinearGradientBrush(0, 0, 0, rect.height, startColor, endColor));
-            gc->DrawRoundedRectangle(5, 5, rect.width-10, rect.height-10, 15);
-            
-            // Add subtle highlight at top
-            wxColour highlightColor(255, 255, 255, 40);
-            gc->SetBrush(gc->CreateLinearGradientBrush(0, 0, 0, 30, highlightColor, wxColour(255,255,255,0)));
-            gc->DrawRoundedRectangle(5, 5, rect.width-10, 30, 15);
-            
-            delete gc;
-        }
+    mainPanel->Bind(wxEVT_PAINT, &AlarmFrame::OnPaintBackground, this);
+    mainPanel->Bind(wxEVT_SIZE, [this](wxSizeEvent& event) {
+        mainPanel->Refresh();
+        event.Skip();
+    });
+    mainPanel->Bind(wxEVT_SYS_COLOUR_CHANGED, [this](wxSysColourChangedEvent& event) {
+        backgroundCache = wxBitmap();
+        mainPanel->Refresh();
+        event.Skip();
     });
     
     wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
 
     // Modern clock display
-    currentTimeText = new wxStaticText(mainPanel, wxID_ANY, _("Current Time: ") + GetCurrentTime());
+    currentTimeText = new ClockWidget(mainPanel, [this](wxDC& dc, const wxPoint& origin) {
+        UpdateBackgroundCache();
+        if (backgroundCache.IsOk()) {
+            dc.DrawBitmap(backgroundCache, -origin.x, -origin.y);
+        }
+    });
     wxFont timeFont = currentTimeText->GetFont();
     timeFont.SetPointSize(24);
     timeFont.SetWeight(wxFONTWEIGHT_BOLD);
     currentTimeText->SetFont(timeFont);
     currentTimeText->SetForegroundColour(wxColour(20, 20, 100));
+    UpdateClock();
     mainSizer->Add(currentTimeText, 0, wxALL | wxALIGN_CENTER, 10);
 
     // Styled input section with rounded corners
@@ -473,6 +4469,17 @@ void AlarmFrame::CreateUI() {
     daySizer->Add(dayChoice, 1, wxALL | wxALIGN_CENTER_VERTICAL, 5);
     inputSizer->Add(daySizer, 0, wxEXPAND | wxALL, 5);
 
+    // Label, found again through the search above the list
+    wxBoxSizer* labelSizer = new wxBoxSizer(wxHORIZONTAL);
+    wxStaticText* labelLabel = new wxStaticText(inputPanel, wxID_ANY, _("Label:"));
+    labelLabel->SetForegroundColour(wxColour(50, 50, 100));
+    labelInput = new wxTextCtrl(inputPanel, wxID_ANY, "");
+    labelInput->SetHint(_("Optional"));
+
+    labelSizer->Add(labelLabel, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    labelSizer->Add(labelInput, 1, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    inputSizer->Add(labelSizer, 0, wxEXPAND | wxALL, 5);
+
     // Sound selection with modern styling
     wxBoxSizer* soundSizer = new wxBoxSizer(wxHORIZONTAL);
     wxStaticText* soundLabel = new wxStaticText(inputPanel, wxID_ANY, _("Sound:"));
@@ -512,13 +4519,43 @@ void AlarmFrame::CreateUI() {
     listBox->SetForegroundColour(wxColour(50, 50, 100));
     wxStaticBoxSizer* listBoxSizer = new wxStaticBoxSizer(listBox, wxVERTICAL);
 
-    alarmList = new wxListCtrl(listBox, wxID_ANY, wxDefaultPosition, wxDefaultSize,
-                             wxLC_REPORT | wxLC_SINGLE_SEL);
+    // Narrows the list as you type: label search, time range, weekday
+    wxBoxSizer* filterSizer = new wxBoxSizer(wxHORIZONTAL);
+    searchInput = new wxSearchCtrl(listBox, wxID_ANY);
+    searchInput->ShowCancelButton(true);
+    searchInput->SetDescriptiveText(_("Search labels"));
+    fromInput = new wxTextCtrl(listBox, wxID_ANY, "", wxDefaultPosition, wxSize(60, -1), wxTE_CENTRE);
+    fromInput->SetHint(_("From"));
+    toInput = new wxTextCtrl(listBox, wxID_ANY, "", wxDefaultPosition, wxSize(60, -1), wxTE_CENTRE);
+    toInput->SetHint(_("To"));
+    filterDayChoice = new wxChoice(listBox, wxID_ANY);
+    filterDayChoice->Append(_("Any Day"));
+    filterDayChoice->Append(_("Monday"));
+    filterDayChoice->Append(_("Tuesday"));
+    filterDayChoice->Append(_("Wednesday"));
+    filterDayChoice->Append(_("Thursday"));
+    filterDayChoice->Append(_("Friday"));
+    filterDayChoice->Append(_("Saturday"));
+    filterDayChoice->Append(_("Sunday"));
+    filterDayChoice->SetSelection(0);
+
+    filterSizer->Add(searchInput, 1, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    filterSizer->Add(fromInput, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    filterSizer->Add(toInput, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    filterSizer->Add(filterDayChoice, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    listBoxSizer->Add(filterSizer, 0, wxEXPAND);
+
+    alarmList = new AlarmListCtrl(listBox, [this](long row, long column) {
+        return AlarmCellText(row, column);
+    });
+    alarmList->Bind(wxEVT_LIST_COL_CLICK, &AlarmFrame::OnAlarmColumnClick, this);
     alarmList->SetBackgroundColour(wxColour(250, 250, 255));
     alarmList->InsertColumn(0, _("Time"));
     alarmList->InsertColumn(1, _("Day"));
+    alarmList->InsertColumn(2, _("Label"));
     alarmList->SetColumnWidth(0, 150);
     alarmList->SetColumnWidth(1, 150);
+    alarmList->SetColumnWidth(2, 200);
     listBoxSizer->Add(alarmList, 1, wxEXPAND | wxALL, 5);
 
     // Delete button with modern styling
@@ -547,154 +4584,591 @@ void AlarmFrame::CreateUI() {
     // Bind events
     setAlarmButton->Bind(wxEVT_BUTTON, &AlarmFrame::OnSetAlarm, this);
     deleteButton->Bind(wxEVT_BUTTON, &AlarmFrame::OnDeleteAlarm, this);
+    searchInput->Bind(wxEVT_TEXT, &AlarmFrame::OnAlarmFilterChanged, this);
+    searchInput->Bind(wxEVT_SEARCHCTRL_CANCEL_BTN, [this](wxCommandEvent&) {
+        searchInput->Clear();
+    });
+    fromInput->Bind(wxEVT_TEXT, &AlarmFrame::OnAlarmFilterChanged, this);
+    toInput->Bind(wxEVT_TEXT, &AlarmFrame::OnAlarmFilterChanged, this);
+    filterDayChoice->Bind(wxEVT_CHOICE, &AlarmFrame::OnAlarmFilterChanged, this);
     langChoice->Bind(wxEVT_CHOICE, &AlarmFrame::OnLanguageChange, this);
     volumeSlider->Bind(wxEVT_SLIDER, &AlarmFrame::OnVolumeChange, this);
 }
 
-void AlarmFrame::OnSoundSettings(wxCommandEvent& event) {
-    SoundSettingsDialog dlg(this, sounds, soundChoice);
-    dlg.ShowModal();
+void AlarmFrame::OnSoundSettings(wxCommandEvent& event) {
+    SoundSettingsDialog dlg(this, sounds, soundChoice);
+    dlg.ShowModal();
+}
+
+void AlarmFrame::OnLanguageChange(wxCommandEvent& event) {
+    wxStopWatch watch;
+    wxLanguage chosen = event.GetString() == "العربية" ? wxLANGUAGE_ARABIC : wxLANGUAGE_ENGLISH;
+    if (chosen == language || !catalogs.Activate(chosen)) {
+        return;
+    }
+    language = chosen;
+
+    // Refresh UI with new language and layout
+    RefreshUI();
+    wxLogTrace(TRACE_TIMING, "Switched language in %ld ms", watch.Time());
+}
+
+// The gradient is only drawn again when the panel's size, scale or
+// direction changes or the system theme does
+void AlarmFrame::OnPaintBackground(wxPaintEvent& event) {
+    wxStopWatch watch;
+    wxPaintDC dc(mainPanel);
+    bool render = UpdateBackgroundCache();
+    if (backgroundCache.IsOk()) {
+        dc.DrawBitmap(backgroundCache, 0, 0);
+    }
+    wxLogTrace(TRACE_TIMING, "Painted the background in %lld us%s", (long long)watch.TimeInMicro().GetValue(),
+               render ? " (rendered)" : "");
+}
+
+// True if the background had to be rendered again
+bool AlarmFrame::UpdateBackgroundCache() {
+    wxSize size = mainPanel->GetClientSize();
+    double scale = mainPanel->GetContentScaleFactor();
+    wxLayoutDirection direction = mainPanel->GetLayoutDirection();
+    if (backgroundCache.IsOk() && size == backgroundSize && scale == backgroundScale &&
+        direction == backgroundDirection) {
+        return false;
+    }
+    RenderBackground(size, scale);
+    backgroundSize = size;
+    backgroundScale = scale;
+    backgroundDirection = direction;
+    return true;
+}
+
+void AlarmFrame::RenderBackground(const wxSize& size, double scale) {
+    const wxColour startColor(190, 210, 255);  // Lighter blue
+    const wxColour endColor(220, 230, 255);    // Very light blue
+
+    if (size.x <= 0 || size.y <= 0 ||
+        !backgroundCache.CreateScaled(size.x, size.y, wxBITMAP_SCREEN_DEPTH, scale)) {
+        backgroundCache = wxBitmap();
+        return;
+    }
+    wxMemoryDC dc(backgroundCache);
+    dc.SetBackground(wxBrush(mainPanel->GetBackgroundColour()));
+    dc.Clear();
+
+    // Create rounded rectangle background
+    wxGraphicsContext* gc = wxGraphicsContext::Create(dc);
+    if (gc) {
+        // Main gradient
+        gc->SetBrush(gc->CreateLinearGradientBrush(0, 0, 0, size.y, startColor, endColor));
+        gc->DrawRoundedRectangle(5, 5, size.x-10, size.y-10, 15);
+
+        // Add subtle highlight at top
+        wxColour highlightColor(255, 255, 255, 40);
+        gc->SetBrush(gc->CreateLinearGradientBrush(0, 0, 0, 30, highlightColor, wxColour(255,255,255,0)));
+        gc->DrawRoundedRectangle(5, 5, size.x-10, 30, 15);
+
+        delete gc;
+    }
+}
+
+void AlarmFrame::RefreshUI() {
+    // Update all text elements with new translations
+    SetTitle(_("Desktop Alarm"));
+    UpdateClock();
+    TranslateListTexts();
+    amPmChoice->SetString(0, _("AM"));
+    amPmChoice->SetString(1, _("PM"));
+
+    // Update layout direction for all controls
+    const wxLanguageInfo* info = wxLocale::GetLanguageInfo(language);
+    wxLayoutDirection dir = info && info->LayoutDirection == wxLayout_RightToLeft ? wxLayout_RightToLeft
+                                                                                  : wxLayout_LeftToRight;
+    SetLayoutDirection(dir);
+    if (GetMenuBar()) {
+        GetMenuBar()->SetLayoutDirection(dir);
+    }
+    mainPanel->SetLayoutDirection(dir);
+    mainPanel->Layout();
+
+    // The columns are retitled in place; the rows are unchanged and are
+    // drawn from the tables, so repainting the visible ones is enough
+    alarmList->SetLayoutDirection(dir);
+    SetAlarmColumns();
+    
+    // Apply modern styling
+    wxFont modernFont = alarmList->GetFont();
+    modernFont.SetPointSize(10);
+    alarmList->SetFont(modernFont);
+    
+    // Refresh all controls
+    alarmTimeInput->SetLayoutDirection(dir);
+    labelInput->SetLayoutDirection(dir);
+    searchInput->SetLayoutDirection(dir);
+    filterDayChoice->SetLayoutDirection(dir);
+    dayChoice->SetLayoutDirection(dir);
+    soundChoice->SetLayoutDirection(dir);
+    amPmChoice->SetLayoutDirection(dir);
+    volumeSlider->SetLayoutDirection(dir);
+    
+    // Update gradient background
+    mainPanel->Refresh();
+    
+    alarmList->Refresh();
+    if (weekView) {
+        weekFrame->SetTitle(_("Alarms by Week"));
+        weekView->Refresh();
+    }
+    Layout();
+}
+
+// Fills dayTexts and minuteTexts for the active language and time format
+void AlarmFrame::TranslateListTexts() {
+    wxString days[7];
+    for (int i = 0; i < 7; i++) {
+        days[i] = wxGetTranslation(kDayNames[i]);
+    }
+    dayTexts[kEveryDayMask] = _("Every Day");
+    for (unsigned mask = 0; mask < kEveryDayMask; mask++) {
+        dayTexts[mask].clear();
+        for (int i = 0; i < 7; i++) {
+            if (mask & (1u << i)) {
+                dayTexts[mask] += (dayTexts[mask].empty() ? "" : ", ") + days[i];
+            }
+        }
+    }
+
+    minuteTexts.resize(24 * 60);
+    for (int minute = 0; minute < 24 * 60; minute++) {
+        wxString time = FormatMinuteOfDay(minute);
+        minuteTexts[minute] = use24HourFormat ? time : ConvertTo12Hour(time);
+    }
+}
+
+// Titles the list's columns, aligned for the layout direction
+void AlarmFrame::SetAlarmColumns() {
+    const wxString titles[] = {_("Time"), _("Day"), _("Label")};
+    bool rightToLeft = alarmList->GetLayoutDirection() == wxLayout_RightToLeft;
+    for (int i = 0; i < 3; i++) {
+        wxListItem column;
+        column.SetText(titles[i]);
+        column.SetAlign(rightToLeft ? wxLIST_FORMAT_RIGHT : wxLIST_FORMAT_LEFT);
+        alarmList->SetColumn(i, column);
+    }
+#if wxCHECK_VERSION(3, 1, 6)
+    alarmList->ShowSortIndicator(alarmOrder.column, alarmOrder.ascending);
+#endif
+}
+
+void AlarmFrame::UpdateCurrentTime(wxTimerEvent& event) {
+    zone.Advance(time(0));
+    UpdateClock();
+    ArmClockTimer();
+}
+
+void AlarmFrame::UpdateClock() {
+    time_t now = time(0);
+    UpdateOccupancyWeek(now);
+    wxString seconds;
+    if (showSeconds) {
+        seconds = wxString::Format(":%02d", (int)(((int64_t)now + zone.OffsetAt(now)) % 60));
+    }
+    currentTimeText->SetTime(_("Current Time: ") + FormatTime(now), seconds);
+}
+
+// One-shot, for just after the next change the clock shows: the next
+// minute, or the next second while seconds are shown
+void AlarmFrame::ArmClockTimer() {
+    using namespace std::chrono;
+    long long now = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    long long period = showSeconds ? 1000 : 60 * 1000;
+    timer->StartOnce((int)(period - now % period) + 10);
+}
+
+void AlarmFrame::OnShowSeconds(wxCommandEvent& event) {
+    showSeconds = event.IsChecked();
+    UpdateClock();
+    if (timer->IsRunning()) {
+        ArmClockTimer();
+    }
+}
+
+// From the snapshot when one is given
+void AlarmFrame::RefreshAlarmList(const AlarmSnapshot* snapshot) {
+    SetAlarmColumns();
+
+    alarmRows.clear();
+    alarmRowOfId.clear();
+    alarmLabels.clear();
+    alarmRules.clear();
+    // Labels are kept with the rows, so painting the list never queries
+    auto add = [&](int id, int minuteOfDay, unsigned dayMask, const char* recurrence, const char* label) {
+        alarmRows.emplace_back(minuteOfDay, dayMask, id);
+        if (*label) {
+            alarmLabels.emplace(id, wxString::FromUTF8(label));
+        }
+        RecurrenceRule rule;
+        if (recurrence && *recurrence && rule.Parse(recurrence) && !rule.IsPlainWeekly()) {
+            alarmRules.emplace(id, std::move(rule));
+        }
+    };
+    if (snapshot) {
+        alarmRows.reserve(snapshot->Count());
+        snapshot->ForEachAlarm(add);
+    } else {
+        store.ForEachAlarm(add);
+    }
+    std::sort(alarmRows.begin(), alarmRows.end(), alarmOrder);
+    alarmRowOfId.reserve(alarmRows.size());
+    for (const AlarmRowKey& row : alarmRows) {
+        alarmRowOfId.emplace(std::get<2>(row), row);
+    }
+    RebuildOccupancy();
+    // Ids may have changed wholesale, so the label search starts over
+    FilterAlarmRows(true);
+}
+
+// Rows stay in alarmOrder, so a row goes in by binary search; the list
+// control only needs its count updated and the visible rows repainted
+void AlarmFrame::InsertAlarmRow(int id, int minuteOfDay, unsigned dayMask, const std::string& label,
+                                const RecurrenceRule& rule) {
+    AlarmRowKey key(minuteOfDay, dayMask, id);
+    alarmRows.insert(std::lower_bound(alarmRows.begin(), alarmRows.end(), key, alarmOrder), key);
+    alarmRowOfId[id] = key;
+    if (!label.empty()) {
+        alarmLabels[id] = wxString::FromUTF8(label.c_str());
+    }
+    if (!rule.IsPlainWeekly()) {
+        alarmRules[id] = rule;
+    }
+    occupancy.Add(minuteOfDay, WeekDaysRinging(id, dayMask), 1);
+    if (weekView) {
+        weekView->Refresh();
+    }
+    if (alarmFilter.Active() && alarmFilter.Passes(key) &&
+        (alarmFilter.words.empty() || store.LabelMatches(id, alarmFilter.words))) {
+        if (!alarmFilter.words.empty()) {
+            labelMatches.insert(id);
+        }
+        shownRows.insert(std::lower_bound(shownRows.begin(), shownRows.end(), key, alarmOrder), key);
+    }
+    alarmList->SetItemCount((long)ListedRows().size());
+    alarmList->Refresh();
+}
+
+unsigned AlarmFrame::WeekDaysRinging(int id, unsigned dayMask) const {
+    auto rule = alarmRules.find(id);
+    return occupancy.DaysRinging(dayMask, rule != alarmRules.end() ? &rule->second : nullptr);
+}
+
+// For the week under way; rules make the counts differ from week to week
+void AlarmFrame::RebuildOccupancy() {
+    int32_t today = zone.LocalDay(time(0));
+    occupancy.Clear(today - (WeekdayFromDays(today) + 6) % 7);
+    for (const AlarmRowKey& row : alarmRows) {
+        occupancy.Add(std::get<0>(row), WeekDaysRinging(std::get<2>(row), std::get<1>(row)), 1);
+    }
+    if (weekView) {
+        weekView->Refresh();
+    }
+}
+
+void AlarmFrame::UpdateOccupancyWeek(time_t now) {
+    int32_t today = zone.LocalDay(now);
+    if (today < occupancy.Monday() || today >= occupancy.Monday() + 7) {
+        RebuildOccupancy();
+    }
+}
+
+void AlarmFrame::RemoveAlarmRow(int id) {
+    auto found = alarmRowOfId.find(id);
+    if (found == alarmRowOfId.end()) {
+        return;
+    }
+    alarmRows.erase(std::lower_bound(alarmRows.begin(), alarmRows.end(), found->second, alarmOrder));
+    auto shown = std::lower_bound(shownRows.begin(), shownRows.end(), found->second, alarmOrder);
+    if (shown != shownRows.end() && *shown == found->second) {
+        shownRows.erase(shown);
+    }
+    labelMatches.erase(id);
+    alarmLabels.erase(id);
+    occupancy.Add(std::get<0>(found->second), WeekDaysRinging(id, std::get<1>(found->second)), -1);
+    alarmRules.erase(id);
+    if (weekView) {
+        weekView->Refresh();
+    }
+    alarmRowOfId.erase(found);
+    alarmList->SetItemCount((long)ListedRows().size());
+    alarmList->Refresh();
+}
+
+void AlarmFrame::OnAlarmFilterChanged(wxCommandEvent& event) {
+    FilterAlarmRows();
+}
+
+// Reads the filter controls and narrows the list to match. A time that
+// doesn't parse leaves that end of the range open, so a half-typed one
+// filters nothing out. Time and weekday are checked against the rows in
+// memory; new words start a label search, whose matches stream in a
+// slice at a time (see ContinueLabelSearch()).
+void AlarmFrame::FilterAlarmRows(bool searchAgain) {
+    wxStopWatch watch;
+    AlarmFilter filter;
+    filter.words = searchInput->GetValue().Strip(wxString::both).utf8_str().data();
+    int hours, minutes;
+    if (CheckClockTime(fromInput->GetValue().ToStdString(), 0, 23, &hours, &minutes) == ClockTimeOk) {
+        filter.fromMinute = hours * 60 + minutes;
+    }
+    if (CheckClockTime(toInput->GetValue().ToStdString(), 0, 23, &hours, &minutes) == ClockTimeOk) {
+        filter.toMinute = hours * 60 + minutes;
+    }
+    // The choice lists Any Day, then Monday through Sunday
+    int daySelection = filterDayChoice->GetSelection();
+    filter.dayMask = daySelection <= 0 ? kEveryDayMask : 1u << (daySelection % 7);
+
+    bool newWords = searchAgain || filter.words != alarmFilter.words;
+    alarmFilter = filter;
+    AlarmRowKey selected;
+    bool hadSelection = TakeAlarmSelection(&selected);
+
+    shownRows.clear();
+    if (newWords) {
+        labelMatches.clear();
+        labelSearchGeneration++;
+        store.EndLabelSearch();
+    }
+    if (!filter.words.empty() && newWords) {
+        store.BeginLabelSearch(filter.words);
+        ContinueLabelSearch(labelSearchGeneration);
+    } else if (filter.Active()) {
+        // The words are the same, so the matches found for them still hold
+        for (const AlarmRowKey& row : alarmRows) {
+            if (filter.Passes(row) && (filter.words.empty() || labelMatches.count(std::get<2>(row)))) {
+                shownRows.push_back(row);
+            }
+        }
+        alarmList->SetItemCount((long)ListedRows().size());
+        alarmList->Refresh();
+    } else {
+        alarmList->SetItemCount((long)alarmRows.size());
+        alarmList->Refresh();
+    }
+    if (hadSelection) {
+        RestoreAlarmSelection(selected);
+    }
+    wxLogTrace(TRACE_TIMING, "Filtered to %zu of %zu alarms in %lld us", ListedRows().size(), alarmRows.size(),
+               (long long)watch.TimeInMicro().GetValue());
+}
+
+// Takes matches from the label index for up to kLabelSearchSliceMs, merges
+// the ones passing the rest of the filter into the list, and queues the
+// next slice behind whatever else is waiting, keystrokes included. A newer
+// search bumps labelSearchGeneration, which drops slices queued for this one.
+void AlarmFrame::ContinueLabelSearch(int generation) {
+    if (generation != labelSearchGeneration) {
+        return;
+    }
+    wxStopWatch watch;
+    std::vector<int> ids;
+    bool more;
+    do {
+        more = store.NextLabelMatches(&ids, 256);
+    } while (more && watch.Time() < kLabelSearchSliceMs);
+
+    std::vector<AlarmRowKey> found;
+    for (int id : ids) {
+        auto row = alarmRowOfId.find(id);
+        if (row != alarmRowOfId.end() && labelMatches.insert(id).second && alarmFilter.Passes(row->second)) {
+            found.push_back(row->second);
+        }
+    }
+    if (!found.empty()) {
+        AlarmRowKey selected;
+        bool hadSelection = TakeAlarmSelection(&selected);
+        std::sort(found.begin(), found.end(), alarmOrder);
+        size_t middle = shownRows.size();
+        shownRows.insert(shownRows.end(), found.begin(), found.end());
+        std::inplace_merge(shownRows.begin(), shownRows.begin() + middle, shownRows.end(), alarmOrder);
+        if (hadSelection) {
+            RestoreAlarmSelection(selected);
+        }
+    }
+    alarmList->SetItemCount((long)shownRows.size());
+    alarmList->Refresh();
+    if (more) {
+        CallAfter([this, generation] {
+            ContinueLabelSearch(generation);
+        });
+    }
+}
+
+// Clears the list's selection, returning the row that was selected
+bool AlarmFrame::TakeAlarmSelection(AlarmRowKey* key) {
+    const std::vector<AlarmRowKey>& rows = ListedRows();
+    long selected = alarmList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    if (selected < 0 || selected >= (long)rows.size()) {
+        return false;
+    }
+    *key = rows[selected];
+    alarmList->SetItemState(selected, 0, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+    return true;
 }
 
-void AlarmFrame::OnLanguageChange(wxCommandEvent& event) {
-    wxString lang = event.GetString();
-    if (lang == "العربية") {
-        m_locale.Init(wxLANGUAGE_ARABIC);
-        SetLayoutDirection(wxLayout_RightToLeft);
-        if (GetMenuBar()) {
-            GetMenuBar()->SetLayoutDirection(wxLayout_RightToLeft);
-        }
-        mainPanel->SetLayoutDirection(wxLayout_RightToLeft);
-    } else {
-        m_locale.Init(wxLANGUAGE_ENGLISH);
-        SetLayoutDirection(wxLayout_LeftToRight);
-        if (GetMenuBar()) {
-            GetMenuBar()->SetLayoutDirection(wxLayout_LeftToRight);
-        }
-        mainPanel->SetLayoutDirection(wxLayout_LeftToRight);
+// Selects `key` again if it is still listed, wherever it is now
+void AlarmFrame::RestoreAlarmSelection(const AlarmRowKey& key) {
+    const std::vector<AlarmRowKey>& rows = ListedRows();
+    auto found = std::lower_bound(rows.begin(), rows.end(), key, alarmOrder);
+    if (found == rows.end() || *found != key) {
+        return;
     }
-    m_locale.AddCatalogLookupPathPrefix(wxT("locale"));
-    m_locale.AddCatalog(wxT("messages"));
-    
-    // Refresh UI with new language and layout
-    RefreshUI();
+    long row = found - rows.begin();
+    alarmList->SetItemState(row, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED,
+                            wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+    alarmList->EnsureVisible(row);
 }
 
-void AlarmFrame::RefreshUI() {
-    // Update all text elements with new translations
-    SetTitle(_("Desktop Alarm"));
-    currentTimeText->SetLabel(_("Current Time: ") + GetCurrentTime());
-    
-    // Update layout direction for all controls
-    bool isArabic = m_locale.GetLanguage() == wxLANGUAGE_ARABIC;
-    wxLayoutDirection dir = isArabic ? wxLayout_RightToLeft : wxLayout_LeftToRight;
-    
-    // Set layout direction for main panel and all its children
-    mainPanel->SetLayoutDirection(dir);
-    mainPanel->Layout();
-    
-    // Update list control appearance and direction
-    alarmList->SetLayoutDirection(dir);
-    alarmList->DeleteAllColumns();
-    if (isArabic) {
-        // For Arabic, add columns in reverse order for proper RTL display
-        alarmList->InsertColumn(0, _("Day"), wxLIST_FORMAT_RIGHT, 150);
-        alarmList->InsertColumn(0, _("Time"), wxLIST_FORMAT_RIGHT, 150);
-    } else {
-        alarmList->InsertColumn(0, _("Time"), wxLIST_FORMAT_LEFT, 150);
-        alarmList->InsertColumn(1, _("Day"), wxLIST_FORMAT_LEFT, 150);
+wxString AlarmFrame::AlarmCellText(long row, long column) {
+    const std::vector<AlarmRowKey>& rows = ListedRows();
+    if (row < 0 || row >= (long)rows.size()) {
+        return "";
     }
-    
-    // Apply modern styling
-    wxFont modernFont = alarmList->GetFont();
-    modernFont.SetPointSize(10);
-    alarmList->SetFont(modernFont);
-    
-    // Refresh all controls
-    alarmTimeInput->SetLayoutDirection(dir);
-    dayChoice->SetLayoutDirection(dir);
-    soundChoice->SetLayoutDirection(dir);
-    amPmChoice->SetLayoutDirection(dir);
-    volumeSlider->SetLayoutDirection(dir);
-    
-    // Update gradient background
-    mainPanel->Refresh();
-    
-    // Refresh alarm list content
-    RefreshAlarmList();
-    Layout();
+    const AlarmRowKey& key = rows[row];
+    if (column == 1) {
+        return dayTexts[std::get<1>(key) & kEveryDayMask];
+    }
+    if (column == 2) {
+        auto label = alarmLabels.find(std::get<2>(key));
+        return label != alarmLabels.end() ? label->second : wxString();
+    }
+    return minuteTexts[std::get<0>(key)];
 }
 
-void AlarmFrame::UpdateCurrentTime(wxTimerEvent& event) {
-    currentTimeText->SetLabel(_("Current Time: ") + GetCurrentTime());
+// Clicking the sorted column again reverses it; labels aren't sortable
+void AlarmFrame::OnAlarmColumnClick(wxListEvent& event) {
+    if (event.GetColumn() > 1) {
+        return;
+    }
+    AlarmRowOrder::Column column = event.GetColumn() == 1 ? AlarmRowOrder::Day : AlarmRowOrder::Time;
+    bool reverse = column == alarmOrder.column;
+    alarmOrder.ascending = !reverse || !alarmOrder.ascending;
+    alarmOrder.column = column;
+    SortAlarmRows(reverse);
 }
 
-void AlarmFrame::RefreshAlarmList() {
-    alarmList->DeleteAllItems();
-    
-    // Update column headers
-    wxListItem col0;
-    col0.SetId(0);
-    col0.SetText(_("Time"));
-    alarmList->SetColumn(0, col0);
-    
-    wxListItem col1;
-    col1.SetId(1);
-    col1.SetText(_("Day"));
-    alarmList->SetColumn(1, col1);
-    
-    sqlite3_stmt* stmt;
-    const char* query = "SELECT time, day FROM alarms ORDER BY time;";
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, 0) == SQLITE_OK) {
-        int row = 0;
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const unsigned char* time = sqlite3_column_text(stmt, 0);
-            const unsigned char* day = sqlite3_column_text(stmt, 1);
-            
-            wxString timeStr = wxString::FromUTF8((const char*)time);
-            if (!use24HourFormat) {
-                timeStr = ConvertTo12Hour(timeStr);
-            }
-            
-            // Add time and day in separate columns
-            long idx = alarmList->InsertItem(row, timeStr);
-            alarmList->SetItem(idx, 1, _(wxString::FromUTF8((const char*)day)));
-            row++;
+// Re-sorts the rows in memory, keeping the selected alarm selected. Every
+// row has a distinct place, so the opposite direction is just the reverse.
+void AlarmFrame::SortAlarmRows(bool reverse) {
+    wxStopWatch watch;
+    AlarmRowKey selected;
+    bool hadSelection = TakeAlarmSelection(&selected);
+
+    for (std::vector<AlarmRowKey>* rows : {&alarmRows, &shownRows}) {
+        if (reverse) {
+            std::reverse(rows->begin(), rows->end());
+        } else {
+            std::sort(rows->begin(), rows->end(), alarmOrder);
         }
     }
-    sqlite3_finalize(stmt);
+#if wxCHECK_VERSION(3, 1, 6)
+    alarmList->ShowSortIndicator(alarmOrder.column, alarmOrder.ascending);
+#endif
+    if (hadSelection) {
+        RestoreAlarmSelection(selected);
+    }
+    alarmList->Refresh();
+    wxLogTrace(TRACE_TIMING, "Sorted %zu alarms in %lld us", alarmRows.size(),
+               (long long)watch.TimeInMicro().GetValue());
 }
 
 void AlarmFrame::OnDeleteAlarm(wxCommandEvent& event) {
+    const std::vector<AlarmRowKey>& rows = ListedRows();
     long selectedItem = alarmList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
-    if (selectedItem != -1) {
-        wxString item = alarmList->GetItemText(selectedItem);
-        wxString time = item.BeforeFirst(' ');
-        DeleteAlarmFromDatabase(time.ToStdString());
-        RefreshAlarmList();
+    if (selectedItem != -1 && selectedItem < (long)rows.size()) {
+        DeleteAlarmFromDatabase(std::get<2>(rows[selectedItem]));
     }
 }
 
-void AlarmFrame::DeleteAlarmFromDatabase(const std::string& time) {
-    std::string query = "DELETE FROM alarms WHERE time = '" + time + "';";
-    sqlite3_exec(db, query.c_str(), 0, 0, 0);
+void AlarmFrame::DeleteAlarmFromDatabase(int id) {
+    databaseWriter->DeleteAlarm(id);
 }
 
 void AlarmFrame::OnClose(wxCloseEvent& event) {
     timer->Stop();
+    wheelTimer->Stop();
     event.Skip();
 }
 
 void AlarmFrame::InitializeDatabase() {
-    if (sqlite3_open("alarms.db", &db) != SQLITE_OK) {
+    // The database key is wrapped under the app password; it only has to be
+    // asked for once it has been changed from the default
+    wxString password = "default";
+    if (!databaseKey.Load("alarms.key", password.ToStdString())) {
+        if (!wxFileExists("alarms.key")) {
+            if (!databaseKey.Generate() || !databaseKey.Save("alarms.key", password.ToStdString())) {
+                wxMessageBox(_("Failed to create the database key!"), _("Error"), wxICON_ERROR);
+                return;
+            }
+        } else {
+            bool unlocked = false;
+            for (int attempt = 0; attempt < 3 && !unlocked; attempt++) {
+                password = wxGetPasswordFromUser(_("Enter password to open your alarms:"), _("Unlock"));
+                if (password.empty()) {
+                    break;
+                }
+                unlocked = databaseKey.Load("alarms.key", password.utf8_str().data());
+            }
+            if (!unlocked) {
+                wxMessageBox(_("Incorrect password!"), _("Error"), wxICON_ERROR);
+                return;
+            }
+        }
+    }
+    if (databaseKey.Previous()) {
+        resumeKeyPassword = password.utf8_str().data();
+    }
+
+    // Before opening, which creates the WAL and so changes the stamp
+    snapshotCurrent = snapshot.Load("alarms.snapshot", "alarms.db", databaseKey.Data());
+    if (!store.Open("alarms.db", databaseKey.Data(), databaseKey.Previous())) {
         wxMessageBox(_("Failed to open database!"), _("Error"), wxICON_ERROR);
+    } else if (!store.Upgrade()) {
+        wxMessageBox(_("Failed to upgrade database!"), _("Error"), wxICON_ERROR);
+    } else if (!store.LoadPasswordHash(&passwordHash)) {
+        // First run with a password hash: its cost is fitted to this machine
+        // once, off the GUI thread, and the writer saves it
+        auto hash = std::make_shared<PasswordHash>();
+        auto derived = std::make_shared<bool>(false);
+        std::string secret = password.utf8_str().data();
+        RunInBackground([hash, derived, secret] {
+            *hash = PasswordHash::Calibrate();
+            *derived = hash->Derive(secret);
+        }, [this, hash, derived] {
+            if (!*derived) {
+                wxMessageBox(_("Failed to save the password!"), _("Error"), wxICON_ERROR);
+                return;
+            }
+            passwordHash = *hash;
+            databaseWriter->SetPasswordHash(passwordHash);
+        });
     } else {
-        const char* createTableQuery =
-            "CREATE TABLE IF NOT EXISTS alarms ("
-            "id INTEGER PRIMARY KEY, "
-            "time TEXT, "
-            "day TEXT DEFAULT 'Every Day');";
-        sqlite3_exec(db, createTableQuery, 0, 0, 0);
+        // The key file's password just opened the database; a password
+        // change cut short may have left the stored hash behind it
+        auto hash = std::make_shared<PasswordHash>(passwordHash);
+        auto rederived = std::make_shared<bool>(false);
+        std::string secret = password.utf8_str().data();
+        RunInBackground([hash, rederived, secret] {
+            *rederived = !hash->Verify(secret) && hash->Derive(secret);
+        }, [this, hash, rederived] {
+            if (*rederived) {
+                passwordHash = *hash;
+                databaseWriter->SetPasswordHash(passwordHash);
+            }
+        });
+    }
+    if (store.SetAsideByUpgrade() > 0) {
+        wxMessageBox(wxString::Format(_("%d alarms saved by an older version could not be read and were not "
+                                        "converted. They are kept unchanged in the legacy_alarms table of "
+                                        "alarms.db."), store.SetAsideByUpgrade()),
+                     _("Database Upgrade"), wxICON_WARNING);
     }
 }
 
@@ -754,142 +5228,461 @@ void AlarmFrame::PlayAlarmSound() {
 }
 
 std::string AlarmFrame::GetCurrentTime() {
-    time_t now = time(0);
-    tm* localTime = localtime(&now);
+    return FormatTime(time(0));
+}
+
+std::string AlarmFrame::FormatTime(time_t when) {
+    int minuteOfDay = (int)(zone.LocalMinute(when) - (int64_t)zone.LocalDay(when) * 24 * 60);
 
     char buffer[6];
-    strftime(buffer, sizeof(buffer), "%H:%M", localTime);
+    snprintf(buffer, sizeof(buffer), "%02d:%02d", minuteOfDay / 60, minuteOfDay % 60);
 
     return std::string(buffer);
 }
 
 std::string AlarmFrame::GetCurrentDayOfWeek() {
-    time_t now = time(0);
-    tm* ltm = localtime(&now);
-    std::vector<std::string> days = {"Sunday", "Monday", "Tuesday", "Wednesday", 
-                                    "Thursday", "Friday", "Saturday"};
-    return days[ltm->tm_wday];
+    return kDayNames[WeekdayFromDays(zone.LocalDay(time(0)))];
 }
 
-void AlarmFrame::SaveAlarmToDatabase(const std::string& time, const std::string& day) {
-    std::string query = "INSERT INTO alarms (time, day) VALUES ('" + time + "', '" + day + "');";
-    sqlite3_exec(db, query.c_str(), 0, 0, 0);
+// The list and the scheduler pick the new row up once the writer reports it
+void AlarmFrame::SaveAlarmToDatabase(int minuteOfDay, unsigned dayMask, const wxString& label) {
+    databaseWriter->InsertAlarm(minuteOfDay, dayMask, label.utf8_str().data());
 }
 
-void AlarmFrame::OnSetAlarm(wxCommandEvent& event) {
-    wxString alarmTime = alarmTimeInput->GetValue();
-    wxString selectedDay = dayChoice->GetString(dayChoice->GetSelection());
-    
-    // Basic time format validation
-    if (use24HourFormat) {
-        if (alarmTime.length() != 5 || alarmTime[2] != ':' ||
-            !isdigit(alarmTime[0]) || !isdigit(alarmTime[1]) ||
-            !isdigit(alarmTime[3]) || !isdigit(alarmTime[4])) {
-            wxMessageBox(_("Invalid time format! Please use HH:MM format."), _("Error"), wxICON_ERROR);
-            return;
+// Brings the alarm list and the scheduler in line with a batch of writes,
+// touching only the rows that changed
+void AlarmFrame::OnDatabaseWritten(wxThreadEvent& event) {
+    snapshotCurrent = false; // Any commit moves the stamp, alarms changed or not
+    std::vector<AlarmChange> changes = event.GetPayload<std::vector<AlarmChange>>();
+    // Past this many changes rebuilding everything is cheaper than patching
+    const size_t bulkChanges = std::max<size_t>(1000, alarmRows.size() / 8);
+    if (event.GetInt() || changes.size() > bulkChanges) {
+        RefreshAlarmList();
+        LoadAlarmSchedule();
+    } else {
+        wxStopWatch watch;
+        for (const AlarmChange& change : changes) {
+            ApplyAlarmChange(change);
         }
+        wxLogTrace(TRACE_TIMING, "Applied %zu alarm changes in %lld us", changes.size(),
+                   (long long)watch.TimeInMicro().GetValue());
+    }
+    if (!event.GetString().empty()) {
+        wxMessageBox(event.GetString(), _("Error"), wxICON_ERROR);
+    }
+}
 
-        int hours = wxAtoi(alarmTime.Left(2));
-        int minutes = wxAtoi(alarmTime.Right(2));
+void AlarmFrame::OnKeyRotationProgress(wxThreadEvent& event) {
+    int percent = event.GetInt();
+    if (percent < 0) {
+        SetStatusText("");
+    } else if (percent < 100) {
+        SetStatusText(wxString::Format(_("Re-encrypting alarms: %d%%"), percent));
+    } else {
+        SetStatusText(_("Alarms re-encrypted under the new password."));
+    }
+}
 
-        if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
-            wxMessageBox(_("Invalid time! Hours must be 0-23 and minutes 0-59."), _("Error"), wxICON_ERROR);
-            return;
+void AlarmFrame::ApplyAlarmChange(const AlarmChange& change) {
+    snapshotCurrent = false;
+    RemoveAlarmRow(change.id);
+    AlarmSpec alarm;
+    if (change.kind != AlarmChange::Deleted &&
+        ParseAlarm(change.id, change.minuteOfDay, change.dayMask,
+                   change.recurrence.empty() ? nullptr : change.recurrence.c_str(), &alarm)) {
+        InsertAlarmRow(change.id, change.minuteOfDay, change.dayMask, change.label, alarm.rule);
+        schedulerThread->AddAlarm(alarm);
+    } else if (change.kind != AlarmChange::Inserted) {
+        schedulerThread->RemoveAlarm(change.id);
+    }
+}
+
+void AlarmFrame::LoadAlarmSchedule(const AlarmSnapshot* snapshot) {
+    wxStopWatch watch;
+    std::vector<AlarmSpec> alarms;
+
+    auto add = [&](int id, int minuteOfDay, unsigned dayMask, const char* recurrence, const char*) {
+        AlarmSpec alarm;
+        if (ParseAlarm(id, minuteOfDay, dayMask, recurrence, &alarm)) {
+            alarms.push_back(alarm);
         }
+    };
+    if (snapshot) {
+        alarms.reserve(snapshot->Count());
+        snapshot->ForEachAlarm(add);
     } else {
-        if (alarmTime.length() != 5 || alarmTime[2] != ':' ||
-            !isdigit(alarmTime[0]) || !isdigit(alarmTime[1]) ||
-            !isdigit(alarmTime[3]) || !isdigit(alarmTime[4])) {
-            wxMessageBox(_("Invalid time format! Please use HH:MM format."), _("Error"), wxICON_ERROR);
-            return;
-        }
+        store.ForEachAlarm(add);
+    }
+    wxLogTrace(TRACE_TIMING, "Loaded %zu alarms in %ld ms", alarms.size(), watch.Time());
+    schedulerThread->ReplaceAlarms(std::move(alarms));
+}
 
-        int hours = wxAtoi(alarmTime.Left(2));
-        int minutes = wxAtoi(alarmTime.Right(2));
+bool AlarmFrame::ParseAlarm(int id, int minuteOfDay, unsigned dayMask,
+                            const char* recurrence, AlarmSpec* alarm) {
+    if (minuteOfDay < 0 || minuteOfDay >= 24 * 60) {
+        return false;
+    }
 
-        if (hours < 1 || hours > 12 || minutes < 0 || minutes > 59) {
-            wxMessageBox(_("Invalid time! Hours must be 1-12 and minutes 0-59."), _("Error"), wxICON_ERROR);
-            return;
-        }
+    // Alarms without an explicit rule repeat weekly on their day mask
+    RecurrenceRule rule;
+    if (!recurrence || !rule.Parse(recurrence)) {
+        rule = RecurrenceRule();
+        rule.weekdays = dayMask & kEveryDayMask;
+    }
+    if (rule.weekdays == 0) {
+        return false; // Unknown day never matched before either
+    }
+    alarm->id = id;
+    alarm->minuteOfDay = minuteOfDay;
+    alarm->rule = rule;
+    return true;
+}
 
+void AlarmFrame::OnSetAlarm(wxCommandEvent& event) {
+    wxString alarmTime = alarmTimeInput->GetValue();
+    wxString selectedDay = dayChoice->GetString(dayChoice->GetSelection());
+    
+    // Basic time format validation
+    int hours, minutes;
+    switch (CheckClockTime(alarmTime.ToStdString(), use24HourFormat ? 0 : 1, use24HourFormat ? 23 : 12,
+                           &hours, &minutes)) {
+    case ClockTimeMalformed:
+        wxMessageBox(_("Invalid time format! Please use HH:MM format."), _("Error"), wxICON_ERROR);
+        return;
+    case ClockTimeOutOfRange:
+        wxMessageBox(use24HourFormat ? _("Invalid time! Hours must be 0-23 and minutes 0-59.")
+                                     : _("Invalid time! Hours must be 1-12 and minutes 0-59."),
+                     _("Error"), wxICON_ERROR);
+        return;
+    case ClockTimeOk:
+        break;
+    }
+    if (!use24HourFormat) {
         bool isAM = amPmChoice->GetSelection() == 0;
         alarmTime = ConvertTo24Hour(alarmTime, isAM);
     }
 
-    SaveAlarmToDatabase(alarmTime.ToStdString(), selectedDay.ToStdString());
-    RefreshAlarmList();
+    // The choice lists Every Day, then Monday through Sunday
+    int daySelection = dayChoice->GetSelection();
+    unsigned dayMask = daySelection <= 0 ? kEveryDayMask : 1u << (daySelection % 7);
+    SaveAlarmToDatabase(wxAtoi(alarmTime.Left(2)) * 60 + wxAtoi(alarmTime.Right(2)), dayMask,
+                        labelInput->GetValue().Strip(wxString::both));
     alarmTimeInput->Clear();
+    labelInput->Clear();
     wxMessageBox(_("Alarm set for ") + alarmTime + _(" on ") + selectedDay, _("Success"), 
                 wxICON_INFORMATION);
 }
 
-void AlarmFrame::OnCheckAlarm(wxTimerEvent& event) {
-    std::string currentTime = GetCurrentTime();
-    std::string currentDay = GetCurrentDayOfWeek();
+void AlarmFrame::OnAlarmsDue(wxThreadEvent& event) {
+    std::vector<AlarmFire> fires = event.GetPayload<std::vector<AlarmFire>>();
+    double deliveredMs = wxGetUTCTimeUSec().ToDouble() / 1000.0;
+    bool due = false;
+    time_t missedAt = 0;
+    for (const AlarmFire& fire : fires) {
+        if (fire.id == SchedulerThread::kProbeId) {
+            jitterSamples.push_back({fire.firedMs - fire.scheduledMs, deliveredMs - fire.scheduledMs});
+            continue;
+        }
+        double latenessMs = fire.firedMs - fire.scheduledMs;
+        wxLogTrace(TRACE_TIMING, "Alarm %d fired %.3f ms after its deadline, reached the GUI %.3f ms later",
+                   fire.id, latenessMs, deliveredMs - fire.firedMs);
+        // Anything more than a minute late was slept through (suspend, clock step)
+        if (latenessMs >= 60 * 1000.0 && missedAt == 0) {
+            missedAt = (time_t)(fire.scheduledMs / 1000);
+        }
+        due = true;
+    }
+
+    if (jitterProbesExpected > 0 && (int)jitterSamples.size() >= jitterProbesExpected) {
+        ShowJitterReport();
+    }
+
+    if (due) {
+        std::string currentTime = GetCurrentTime();
+        std::string currentDay = GetCurrentDayOfWeek();
+        wxString message = wxString::Format(_("⏰ Time to wake up!\nCurrent time: %s\nDay: %s"), 
+                                          currentTime, currentDay);
+        if (missedAt != 0) {
+            message += wxString::Format(_("\nMissed while the computer was asleep: %s"), FormatTime(missedAt));
+        }
+        ShowAlarm(message);
+    }
+}
+
+void AlarmFrame::OnTimeZoneChanged(wxThreadEvent& event) {
+    zone.Refresh(time(0));
+    UpdateClock();
+}
+
+// Compares probe lateness on the scheduler thread with when the GUI got to
+// see them while the GUI thread is deliberately kept busy
+void AlarmFrame::OnMeasureJitter(wxCommandEvent& event) {
+    const int probes = 5;
+    jitterSamples.clear();
+    jitterProbesExpected = probes;
+    schedulerThread->StartJitterProbe(probes);
+    wxMilliSleep((probes + 1) * 1000);
+}
+
+void AlarmFrame::ShowJitterReport() {
+    double threadMax = 0, threadSum = 0, guiMax = 0, guiSum = 0;
+    for (const auto& sample : jitterSamples) {
+        threadMax = std::max(threadMax, sample.first);
+        threadSum += sample.first;
+        guiMax = std::max(guiMax, sample.second);
+        guiSum += sample.second;
+    }
+    size_t count = jitterSamples.size();
+    jitterProbesExpected = 0;
+    jitterSamples.clear();
+
+    wxMessageBox(wxString::Format(_("%d probes with the window blocked.\n"
+                                    "Scheduler thread lateness: %.1f ms average, %.1f ms worst\n"
+                                    "Seen by the window: %.1f ms average, %.1f ms worst"),
+                                  (int)count, threadSum / count, threadMax, guiSum / count, guiMax),
+                 _("Alarm Jitter"), wxICON_INFORMATION);
+}
+
+// Ticks of the timing wheel: whole seconds of a clock that never jumps
+static int64_t MonotonicMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns at once: the sound has started and the notification is up or
+// queued behind one for an earlier minute
+void AlarmFrame::ShowAlarm(const wxString& message) {
+    notifications->Post(zone.LocalMinute(time(0)), message);
+}
+
+TimingWheel::Handle AlarmFrame::StartOneShot(int seconds, const wxString& message) {
+    // The wheel's clock only moves when it is advanced, so bring it up to
+    // now before filing a timer against it
+    int64_t now = MonotonicMillis() / 1000;
+    AdvanceWheel(now);
+    TimingWheel::Handle handle = wheel.Add(now + seconds, now);
+    oneShotMessages[handle] = message;
+    ArmWheelTimer();
+    return handle;
+}
+
+void AlarmFrame::ArmWheelTimer() {
+    int64_t tick = wheel.NextTick();
+    if (tick == -1) {
+        wheelTimer->Stop();
+        return;
+    }
+    int64_t delay = tick * 1000 - MonotonicMillis();
+    wheelTimer->StartOnce((int)std::max<int64_t>(1, std::min<int64_t>(delay, 60 * 60 * 1000)));
+}
 
-    sqlite3_stmt* stmt;
-    const char* query = "SELECT time FROM alarms WHERE time = ? AND (day = ? OR day = 'Every Day');";
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, currentTime.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, currentDay.c_str(), -1, SQLITE_STATIC);
+void AlarmFrame::OnWheelTimer(wxTimerEvent& event) {
+    AdvanceWheel(MonotonicMillis() / 1000);
+}
 
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            wxString message = wxString::Format(_("⏰ Time to wake up!\nCurrent time: %s\nDay: %s"), 
-                                              currentTime, currentDay);
-            wxMessageBox(message, _("Alarm"), wxICON_INFORMATION | wxSTAY_ON_TOP);
-            PlayAlarmSound();
+// Rings the one-shot timers due by `now`
+void AlarmFrame::AdvanceWheel(int64_t now) {
+    std::vector<wxString> expired;
+    wheel.Advance(now, [&](TimingWheel::Handle handle) {
+        auto it = oneShotMessages.find(handle);
+        if (it != oneShotMessages.end()) {
+            expired.push_back(it->second);
+            oneShotMessages.erase(it);
         }
+    });
+    ArmWheelTimer();
+
+    for (const wxString& message : expired) {
+        ShowAlarm(message);
+    }
+}
+
+void AlarmFrame::OnStartCountdown(wxCommandEvent& event) {
+    long minutes = wxGetNumberFromUser(_("Ring after how many minutes?"), _("Minutes:"),
+                                       _("Start Countdown"), 25, 1, 24 * 60, this);
+    if (minutes > 0) {
+        StartOneShot((int)minutes * 60,
+                     wxString::Format(_("⏰ Your %ld minute countdown has finished!"), minutes));
+    }
+}
+
+void AlarmFrame::OnCancelTimers(wxCommandEvent& event) {
+    for (const auto& entry : oneShotMessages) {
+        wheel.Cancel(entry.first);
+    }
+    oneShotMessages.clear();
+    ArmWheelTimer();
+}
+
+void AlarmFrame::OnImportAlarms(wxCommandEvent& event) {
+    if (isLocked) {
+        wxMessageBox(_("Please unlock the application first."), _("Error"), wxICON_ERROR);
+        return;
+    }
+    // One import at a time
+    if (importProgress) {
+        importProgress->Raise();
+        return;
+    }
+    wxFileDialog openFileDialog(this, _("Import Alarms"), "", "",
+                                _("Alarm files (*.csv;*.ics)|*.csv;*.ics"),
+                                wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (openFileDialog.ShowModal() == wxID_CANCEL) {
+        return;
+    }
+    wxString path = openFileDialog.GetPath();
+    FILE* in = wxFopen(path, "rb");
+    if (!in) {
+        wxMessageBox(_("Failed to open file!"), _("Error"), wxICON_ERROR);
+        return;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+
+    // The writer imports it, so alarms keep firing and the clock keeps
+    // ticking; the list catches up through OnDatabaseWritten
+    importCancel = std::make_shared<std::atomic<bool>>(false);
+    importProgress = new wxProgressDialog(_("Import Alarms"), _("Importing alarms..."), 1000, this,
+                                          wxPD_CAN_ABORT | wxPD_ELAPSED_TIME);
+    databaseWriter->ImportAlarms(in, size, path.Lower().EndsWith(".ics"), zone, importCancel);
+}
+
+void AlarmFrame::OnImportProgress(wxThreadEvent& event) {
+    if (importProgress && !importProgress->Update(event.GetInt())) {
+        *importCancel = true;
+    }
+}
+
+void AlarmFrame::OnImportFinished(wxThreadEvent& event) {
+    if (importProgress) {
+        importProgress->Destroy();
+        importProgress = nullptr;
+    }
+    AlarmTransfer::Result result = event.GetPayload<AlarmTransfer::Result>();
+    if (!event.GetInt() && !result.cancelled) {
+        wxMessageBox(_("Failed to save alarms to the database!"), _("Error"), wxICON_ERROR);
+    }
+    wxString summary = wxString::Format(_("Imported %d alarms."), result.imported);
+    if (result.rejected > 0) {
+        summary += "\n" + wxString::Format(_("Skipped %d invalid entries, the first on line %d."),
+                                           result.rejected, result.firstRejectedLine);
+    }
+    wxMessageBox(summary, _("Import Alarms"), wxICON_INFORMATION);
+}
+
+void AlarmFrame::OnExportAlarms(wxCommandEvent& event) {
+    if (isLocked) {
+        wxMessageBox(_("Please unlock the application first."), _("Error"), wxICON_ERROR);
+        return;
+    }
+    wxFileDialog saveFileDialog(this, _("Export Alarms"), "", "alarms.csv",
+                                _("CSV files (*.csv)|*.csv|iCalendar files (*.ics)|*.ics"),
+                                wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) {
+        return;
+    }
+    wxString path = saveFileDialog.GetPath();
+    FILE* out = wxFopen(path, "wb");
+    bool ok = out != nullptr;
+    if (ok) {
+        ok = path.Lower().EndsWith(".ics")
+                 ? AlarmTransfer::ExportICalendar(out, store, zone.LocalDay(time(0)))
+                 : AlarmTransfer::ExportCsv(out, store);
+        ok = fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+        wxMessageBox(_("Failed to write file!"), _("Error"), wxICON_ERROR);
     }
-    sqlite3_finalize(stmt);
+}
+
+// A window of its own, drawn from `occupancy`, which the list keeps up
+// to date; opening it again brings the open one forward
+void AlarmFrame::OnWeekView(wxCommandEvent& event) {
+    if (weekFrame) {
+        weekFrame->Raise();
+        return;
+    }
+    UpdateOccupancyWeek(time(0));
+    weekFrame = new wxFrame(this, wxID_ANY, _("Alarms by Week"));
+    weekView = new WeekView(weekFrame, occupancy);
+    weekFrame->SetClientSize(weekView->GetBestSize());
+    weekFrame->Bind(wxEVT_CLOSE_WINDOW, [this](wxCloseEvent& event) {
+        weekFrame = nullptr;
+        weekView = nullptr;
+        event.Skip();
+    });
+    weekFrame->Show();
 }
 
 void AlarmFrame::OnIconize(wxIconizeEvent& event) {
     Hide();
 }
 
+void AlarmFrame::OnShow(wxShowEvent& event) {
+    // Nobody sees the clock while we sit in the tray, so stop waking up for it
+    if (event.IsShown()) {
+        UpdateClock();
+        ArmClockTimer();
+    } else {
+        timer->Stop();
+    }
+    event.Skip();
+}
+
 void AlarmFrame::InitializeSecurity() {
     isLocked = false;
-    hashedPassword = HashPassword("default"); // Default password
 }
 
-wxString AlarmFrame::HashPassword(const wxString& password) {
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hashLen;
-    
-    // Create digest context
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx) return "";
-    
-    // Initialize with SHA256
-    if (!EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr)) {
-        EVP_MD_CTX_free(ctx);
-        return "";
-    }
-    
-    // Update with password
-    if (!EVP_DigestUpdate(ctx, password.c_str(), password.length())) {
-        EVP_MD_CTX_free(ctx);
-        return "";
+// Checks `password` against the stored hash on a background thread, as the
+// derivation is deliberately slow, then calls `done` on the GUI thread
+void AlarmFrame::CheckPassword(const wxString& password, std::function<void(bool)> done) {
+    auto matched = std::make_shared<bool>(false);
+    PasswordHash hash = passwordHash;
+    std::string secret = password.utf8_str().data();
+    SetStatusText(_("Checking password..."));
+    RunInBackground([matched, hash, secret] {
+        *matched = hash.Verify(secret);
+    }, [this, matched, done] {
+        SetStatusText("");
+        done(*matched);
+    });
+}
+
+void AlarmFrame::RunInBackground(std::function<void()> work, std::function<void()> done) {
+    backgroundTasks.push({std::move(work), std::move(done)});
+    if (!backgroundTask) {
+        StartBackgroundTask();
     }
-    
-    // Finalize
-    if (!EVP_DigestFinal_ex(ctx, hash, &hashLen)) {
-        EVP_MD_CTX_free(ctx);
-        return "";
+}
+
+void AlarmFrame::StartBackgroundTask() {
+    if (backgroundTasks.empty()) {
+        return;
     }
-    
-    EVP_MD_CTX_free(ctx);
-    
-    // Convert to hex string
-    wxString hashedStr;
-    for(unsigned int i = 0; i < hashLen; i++) {
-        hashedStr += wxString::Format("%02x", hash[i]);
+    backgroundTask = new BackgroundTask(this, backgroundTasks.front().first);
+    if (backgroundTask->Run() != wxTHREAD_NO_ERROR) {
+        // Better a stall than losing the task
+        delete backgroundTask;
+        backgroundTask = nullptr;
+        auto task = std::move(backgroundTasks.front());
+        backgroundTasks.pop();
+        task.first();
+        task.second();
+        StartBackgroundTask();
     }
-    return hashedStr;
 }
 
-bool AlarmFrame::VerifyPassword(const wxString& password) {
-    return hashedPassword == HashPassword(password);
+void AlarmFrame::OnBackgroundTaskDone(wxThreadEvent& event) {
+    backgroundTask->Wait();
+    delete backgroundTask;
+    backgroundTask = nullptr;
+    std::function<void()> done = std::move(backgroundTasks.front().second);
+    backgroundTasks.pop();
+    done();
+    if (!backgroundTask) {
+        StartBackgroundTask();
+    }
 }
 
 void AlarmFrame::LockInterface() {
@@ -901,6 +5694,12 @@ void AlarmFrame::LockInterface() {
     amPmChoice->Disable();
     deleteButton->Disable();
     alarmList->Disable();
+    labelInput->Disable();
+    searchInput->Disable();
+    fromInput->Disable();
+    toInput->Disable();
+    GetMenuBar()->Enable(ID_IMPORT_ALARMS, false);
+    GetMenuBar()->Enable(ID_EXPORT_ALARMS, false);
 }
 
 void AlarmFrame::UnlockInterface() {
@@ -912,6 +5711,12 @@ void AlarmFrame::UnlockInterface() {
     amPmChoice->Enable();
     deleteButton->Enable();
     alarmList->Enable();
+    labelInput->Enable();
+    searchInput->Enable();
+    fromInput->Enable();
+    toInput->Enable();
+    GetMenuBar()->Enable(ID_IMPORT_ALARMS, true);
+    GetMenuBar()->Enable(ID_EXPORT_ALARMS, true);
 }
 
 void AlarmFrame::OnLockApp(wxCommandEvent& event) {
@@ -921,12 +5726,14 @@ void AlarmFrame::OnLockApp(wxCommandEvent& event) {
 
 void AlarmFrame::OnUnlockApp(wxCommandEvent& event) {
     wxString password = wxGetPasswordFromUser(_("Enter password to unlock:"), _("Unlock"));
-    if (VerifyPassword(password)) {
-        UnlockInterface();
-        wxMessageBox(_("Application unlocked."), _("Unlocked"), wxICON_INFORMATION);
-    } else {
-        wxMessageBox(_("Incorrect password!"), _("Error"), wxICON_ERROR);
-    }
+    CheckPassword(password, [this](bool matched) {
+        if (matched) {
+            UnlockInterface();
+            wxMessageBox(_("Application unlocked."), _("Unlocked"), wxICON_INFORMATION);
+        } else {
+            wxMessageBox(_("Incorrect password!"), _("Error"), wxICON_ERROR);
+        }
+    });
 }
 
 void AlarmFrame::OnChangePassword(wxCommandEvent& event) {
@@ -938,126 +5745,54 @@ void AlarmFrame::OnChangePassword(wxCommandEvent& event) {
     wxPasswordEntryDialog oldPassDlg(this, _("Enter current password:"), _("Change Password"));
     if (oldPassDlg.ShowModal() != wxID_OK) return;
 
-    if (!VerifyPassword(oldPassDlg.GetValue())) {
-        wxMessageBox(_("Incorrect current password!"), _("Error"), wxICON_ERROR);
-        return;
-    }
-
-    wxPasswordEntryDialog newPassDlg(this, _("Enter new password:"), _("Change Password"));
-    if (newPassDlg.ShowModal() != wxID_OK) return;
-
-    wxString newPass = newPassDlg.GetValue();
-    if (newPass.Length() < 6) {
-        wxMessageBox(_("Password must be at least 6 characters long!"), _("Error"), wxICON_ERROR);
-        return;
-    }
-
-    wxPasswordEntryDialog confirmDlg(this, _("Confirm new password:"), _("Change Password"));
-    if (confirmDlg.ShowModal() != wxID_OK) return;
-
-    if (newPass != confirmDlg.GetValue()) {
-        wxMessageBox(_("Passwords do not match!"), _("Error"), wxICON_ERROR);
-        return;
-    }
-
-    hashedPassword = HashPassword(newPass);
-    EncryptDatabase(); // Re-encrypt database with new password
-    wxMessageBox(_("Password changed successfully!"), _("Success"), wxICON_INFORMATION);
-}
-
-void AlarmFrame::EncryptDatabase() {
-    // Read current database content
-    std::vector<std::pair<std::string, std::string>> alarms;
-    sqlite3_stmt* stmt;
-    const char* query = "SELECT time, day FROM alarms;";
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, 0) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char* time = (const char*)sqlite3_column_text(stmt, 0);
-            const char* day = (const char*)sqlite3_column_text(stmt, 1);
-            alarms.push_back({std::string(time), std::string(day)});
+    CheckPassword(oldPassDlg.GetValue(), [this](bool matched) {
+        if (!matched) {
+            wxMessageBox(_("Incorrect current password!"), _("Error"), wxICON_ERROR);
+            return;
         }
-    }
-    sqlite3_finalize(stmt);
-
-    // Create secure temporary table
-    const char* createSecureTable = 
-        "CREATE TABLE IF NOT EXISTS secure_alarms ("
-        "id INTEGER PRIMARY KEY, "
-        "encrypted_data BLOB, "
-        "iv BLOB);";
-    sqlite3_exec(db, createSecureTable, 0, 0, 0);
-
-    // Generate key from password using newer EVP interface
-    unsigned char key[32];
-    unsigned char salt[32];
-    if (RAND_bytes(salt, sizeof(salt)) != 1) {
-        return;
-    }
-
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) return;
 
-    // Encrypt each alarm
-    for (const auto& alarm : alarms) {
-        unsigned char iv[EVP_MAX_IV_LENGTH];
-        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
-            EVP_CIPHER_CTX_free(ctx);
-            continue;
-        }
+        wxPasswordEntryDialog newPassDlg(this, _("Enter new password:"), _("Change Password"));
+        if (newPassDlg.ShowModal() != wxID_OK) return;
 
-        std::string data = alarm.first + "|" + alarm.second;
-        if (!EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key, iv)) {
-            EVP_CIPHER_CTX_free(ctx);
-            continue;
+        wxString newPass = newPassDlg.GetValue();
+        if (newPass.Length() < 6) {
+            wxMessageBox(_("Password must be at least 6 characters long!"), _("Error"), wxICON_ERROR);
+            return;
         }
 
-        std::vector<unsigned char> ciphertext(data.length() + EVP_MAX_BLOCK_LENGTH);
-        int len;
-        if (!EVP_EncryptUpdate(ctx, ciphertext.data(), &len,
-                            (unsigned char*)data.c_str(), data.length())) {
-            EVP_CIPHER_CTX_free(ctx);
-            continue;
-        }
+        wxPasswordEntryDialog confirmDlg(this, _("Confirm new password:"), _("Change Password"));
+        if (confirmDlg.ShowModal() != wxID_OK) return;
 
-        int ciphertext_len = len;
-        if (!EVP_EncryptFinal_ex(ctx, ciphertext.data() + len, &len)) {
-            EVP_CIPHER_CTX_free(ctx);
-            continue;
+        if (newPass != confirmDlg.GetValue()) {
+            wxMessageBox(_("Passwords do not match!"), _("Error"), wxICON_ERROR);
+            return;
         }
-        ciphertext_len += len;
 
-        // Store encrypted data
-        sqlite3_stmt* insert_stmt;
-        const char* insert_query = 
-            "INSERT INTO secure_alarms (encrypted_data, iv) VALUES (?, ?);";
-        if (sqlite3_prepare_v2(db, insert_query, -1, &insert_stmt, 0) == SQLITE_OK) {
-            sqlite3_bind_blob(insert_stmt, 1, ciphertext.data(), ciphertext_len, SQLITE_STATIC);
-            sqlite3_bind_blob(insert_stmt, 2, iv, EVP_MAX_IV_LENGTH, SQLITE_STATIC);
-            sqlite3_step(insert_stmt);
-            sqlite3_finalize(insert_stmt);
-        }
-    }
-    
-    EVP_CIPHER_CTX_free(ctx);
+        // Same calibrated cost, fresh salt
+        auto hash = std::make_shared<PasswordHash>(passwordHash);
+        auto derived = std::make_shared<bool>(false);
+        std::string secret = newPass.utf8_str().data();
+        SetStatusText(_("Saving password..."));
+        RunInBackground([hash, derived, secret] {
+            *derived = hash->Derive(secret);
+        }, [this, hash, derived, newPass] {
+            SetStatusText("");
+            if (!*derived) {
+                wxMessageBox(_("Failed to save the password!"), _("Error"), wxICON_ERROR);
+                return;
+            }
+            passwordHash = *hash;
+            EncryptDatabase(newPass, passwordHash);
+            wxMessageBox(_("Password changed successfully!"), _("Success"), wxICON_INFORMATION);
+        });
+    });
 }
 
-wxString AlarmFrame::SecureQuery(const wxString& query, const std::vector<wxString>& params) {
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        return "";
-    }
-    
-    for (size_t i = 0; i < params.size(); i++) {
-        sqlite3_bind_text(stmt, i + 1, params[i].c_str(), -1, SQLITE_STATIC);
-    }
-    
-    wxString result;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        result = wxString::FromUTF8((const char*)sqlite3_column_text(stmt, 0));
-    }
-    
-    sqlite3_finalize(stmt);
-    return result;
+// Stores the new password's hash, then moves the database to a new random
+// key wrapped under `password`, on the writer thread; the old password's
+// key file can't open it afterwards
+void AlarmFrame::EncryptDatabase(const wxString& password, const PasswordHash& hash) {
+    databaseWriter->ChangePassword(password.utf8_str().data(), hash);
 }
 
 void AlarmFrame::OnVolumeChange(wxCommandEvent& event) {
@@ -1081,7 +5816,8 @@ void AlarmFrame::OnTimeFormatChange(wxCommandEvent& event) {
     use24HourFormat = event.IsChecked();
     amPmChoice->Show(!use24HourFormat);
     mainPanel->Layout();
-    RefreshAlarmList(); // Refresh to update time display format
+    TranslateListTexts();
+    alarmList->Refresh(); // Cells are drawn from the tables, now in the new format
 }
 
 wxString AlarmFrame::ConvertTo12Hour(const wxString& time24h, bool* isAM) {
@@ -1119,11 +5855,40 @@ wxString AlarmFrame::ConvertTo24Hour(const wxString& time12h, bool isAM) {
 }
 
 AlarmFrame::~AlarmFrame() {
+    if (backgroundTask) {
+        backgroundTask->Wait();
+        delete backgroundTask;
+    }
     if (timer) {
         timer->Stop();
         delete timer;
     }
-    sqlite3_close(db);
+    if (schedulerThread) {
+        schedulerThread->Shutdown();
+        delete schedulerThread;
+    }
+    if (wheelTimer) {
+        wheelTimer->Stop();
+        delete wheelTimer;
+    }
+    delete notifications;
+    // Queued writes are committed before the writer exits; an import
+    // stops after its current batch
+    if (importCancel) {
+        *importCancel = true;
+    }
+    if (databaseWriter) {
+        databaseWriter->Shutdown();
+        databaseKey = databaseWriter->Key();
+        delete databaseWriter;
+    }
+    // The snapshot is stamped once the last connection has closed and
+    // checkpointed, so it matches the files the next start will find
+    bool saveSnapshot = !snapshotCurrent && snapshot.Collect(store);
+    store.Close();
+    if (saveSnapshot) {
+        snapshot.Save("alarms.snapshot", "alarms.db", databaseKey.Data());
+    }
     if (m_taskBarIcon) {
         m_taskBarIcon->Destroy();
     }
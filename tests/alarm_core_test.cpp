@@ -0,0 +1,511 @@
+// Tests for the wx-free parts of the alarm clock in alarm_core.h. Run with
+// no arguments for every group, or name the groups to run.
+#include "../alarm_core.h"
+
+#include <set>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                                   \
+        }                                                                                 \
+    } while (0)
+
+static int32_t Day(int year, int month, int day) {
+    return DaysFromCivil(year, month, day);
+}
+
+// --- TimingWheel ---
+
+// Runs the wheel tick by tick until it is empty, noting when each timer rang
+static std::map<TimingWheel::Handle, int64_t> RunToEmpty(TimingWheel& wheel) {
+    std::map<TimingWheel::Handle, int64_t> rang;
+    for (int64_t tick = wheel.NextTick(); tick != -1; tick = wheel.NextTick()) {
+        wheel.Advance(tick, [&](TimingWheel::Handle handle) {
+            CHECK(rang.count(handle) == 0);
+            rang[handle] = tick;
+        });
+    }
+    return rang;
+}
+
+static void TestTimingWheelInsert() {
+    TimingWheel wheel;
+    wheel.Reset(1000);
+    CHECK(wheel.NextTick() == -1);
+    TimingWheel::Handle handle = wheel.Add(1005, 1000);
+    CHECK(handle != 0);
+    CHECK(wheel.Size() == 1);
+    CHECK(wheel.NextTick() == 1005);
+
+    int rang = 0;
+    wheel.Advance(1004, [&](TimingWheel::Handle) { rang++; });
+    CHECK(rang == 0);
+    wheel.Advance(1005, [&](TimingWheel::Handle expired) {
+        CHECK(expired == handle);
+        rang++;
+    });
+    CHECK(rang == 1);
+    CHECK(wheel.Size() == 0);
+    CHECK(wheel.NextTick() == -1);
+
+    // A deadline already past rings on the next tick
+    wheel.Add(10, 1005);
+    CHECK(wheel.NextTick() == 1006);
+}
+
+static void TestTimingWheelCancel() {
+    TimingWheel wheel;
+    wheel.Reset(0);
+    TimingWheel::Handle kept = wheel.Add(30, 0);
+    TimingWheel::Handle cancelled = wheel.Add(30, 0);
+    TimingWheel::Handle alone = wheel.Add(5000, 0);
+    CHECK(wheel.Cancel(cancelled));
+    CHECK(!wheel.Cancel(cancelled));
+    CHECK(wheel.Cancel(alone));
+    CHECK(wheel.Size() == 1);
+
+    auto rang = RunToEmpty(wheel);
+    CHECK(rang.size() == 1 && rang[kept] == 30);
+    CHECK(!wheel.Cancel(kept));
+
+    // A reused node gets a new handle; the old one stays dead
+    TimingWheel::Handle reused = wheel.Add(100, 30);
+    CHECK(reused != kept && reused != cancelled && reused != alone);
+    CHECK(!wheel.Cancel(cancelled));
+    CHECK(wheel.Cancel(reused));
+    CHECK(wheel.NextTick() == -1);
+}
+
+// Timers on every level ring at their own second after moving down
+static void TestTimingWheelCascade() {
+    TimingWheel wheel;
+    int64_t start = 86400 * 3 + 3599; // Last second of an hour
+    wheel.Reset(start);
+    std::vector<int64_t> deadlines = {
+        start + 1,                 // Next minute, next hour
+        start + 59,
+        start + 61,
+        start + 3600 + 7,
+        start + 86400 - 3599,      // Next day
+        start + 86400 * 2 + 125,
+        start + 86400 * 63,
+        start + 86400 * 64,        // The top level slot of the current day
+        start + 86400 * 200 + 17,  // Past the top level; waits for its slot to come round
+    };
+    std::map<TimingWheel::Handle, int64_t> expected;
+    for (int64_t deadline : deadlines) {
+        expected[wheel.Add(deadline, start)] = deadline;
+    }
+    CHECK(wheel.Size() == deadlines.size());
+    CHECK(RunToEmpty(wheel) == expected);
+    CHECK(wheel.Size() == 0);
+}
+
+static void TestTimingWheelNextTick() {
+    TimingWheel wheel;
+
+    // Last second of a day: every lower level's mask is exhausted, so the
+    // answer comes from the top level
+    wheel.Reset(86399);
+    wheel.Add(86400 + 30, 86399);
+    CHECK(wheel.NextTick() == 86400);
+
+    // 64 days out lands in the current day's top slot, the last one round
+    wheel.Reset(0);
+    wheel.Add(86400 * 64, 0);
+    CHECK(wheel.NextTick() == 86400 * 64);
+
+    wheel.Reset(125);
+    wheel.Add(125 + 3600, 125);
+    CHECK(wheel.NextTick() == 3600);
+
+    // Regressions for an empty mask, which used to loop forever
+    CHECK(LowestBit(0) == 64);
+    CHECK(LowestBit(1) == 0);
+    CHECK(LowestBit(1ull << 63) == 63);
+    CHECK(LowestBit(0x50) == 4);
+}
+
+// --- RecurrenceRule ---
+
+static RecurrenceRule Rule(const std::string& text) {
+    RecurrenceRule rule;
+    CHECK(rule.Parse(text));
+    return rule;
+}
+
+static void TestRecurrenceNextDay() {
+    // 2024-01-01 is a Monday
+    RecurrenceRule daily = Rule("FREQ=DAILY;INTERVAL=2;DTSTART=20240101");
+    CHECK(daily.NextDay(Day(2023, 12, 1)) == Day(2024, 1, 1));
+    CHECK(daily.NextDay(Day(2024, 1, 2)) == Day(2024, 1, 3));
+    CHECK(daily.NextDay(Day(2024, 3, 1)) == Day(2024, 3, 1));
+
+    RecurrenceRule weekly = Rule("FREQ=WEEKLY;INTERVAL=2;BYDAY=MO,FR;DTSTART=20240101");
+    CHECK(weekly.NextDay(Day(2024, 1, 2)) == Day(2024, 1, 5));
+    CHECK(weekly.NextDay(Day(2024, 1, 6)) == Day(2024, 1, 15));
+
+    RecurrenceRule monthDay = Rule("FREQ=MONTHLY;BYMONTHDAY=31;DTSTART=20240101");
+    CHECK(monthDay.NextDay(Day(2024, 2, 1)) == Day(2024, 3, 31));
+
+    RecurrenceRule lastDay = Rule("FREQ=MONTHLY;BYMONTHDAY=-1;DTSTART=20240101");
+    CHECK(lastDay.NextDay(Day(2024, 2, 1)) == Day(2024, 2, 29));
+
+    RecurrenceRule lastFriday = Rule("FREQ=MONTHLY;BYDAY=-1FR;DTSTART=20240101");
+    CHECK(lastFriday.NextDay(Day(2024, 1, 1)) == Day(2024, 1, 26));
+
+    RecurrenceRule secondMonday = Rule("FREQ=MONTHLY;BYDAY=2MO;DTSTART=20240101");
+    CHECK(secondMonday.NextDay(Day(2024, 1, 1)) == Day(2024, 1, 8));
+    CHECK(secondMonday.NextDay(Day(2024, 1, 9)) == Day(2024, 2, 12));
+
+    RecurrenceRule bounded = Rule("FREQ=DAILY;DTSTART=20240101;UNTIL=20240110;EXDATE=20240102,20240103");
+    CHECK(bounded.NextDay(Day(2024, 1, 2)) == Day(2024, 1, 4));
+    CHECK(bounded.NextDay(Day(2024, 1, 11)) == RecurrenceRule::kNever);
+
+    // A daily rule limited to some days is a weekly one
+    RecurrenceRule weekdays = Rule("FREQ=DAILY;BYDAY=MO,TU;DTSTART=20240101");
+    CHECK(weekdays.frequency == RecurrenceRule::Weekly);
+    CHECK(weekdays.NextDay(Day(2024, 1, 3)) == Day(2024, 1, 8));
+}
+
+static void TestRecurrenceRoundTrip() {
+    const char* rules[] = {
+        "FREQ=DAILY;DTSTART=20240101",
+        "FREQ=DAILY;INTERVAL=3;DTSTART=20240101",
+        "FREQ=WEEKLY;INTERVAL=2;BYDAY=MO,FR;DTSTART=20240101;EXDATE=20240506",
+        "FREQ=MONTHLY;BYDAY=-1FR;DTSTART=20240101",
+        "FREQ=MONTHLY;BYDAY=2MO;DTSTART=20240101",
+        "FREQ=MONTHLY;BYMONTHDAY=15;DTSTART=20240101;UNTIL=20241231",
+        "FREQ=MONTHLY;INTERVAL=3;BYMONTHDAY=-1;DTSTART=20240131",
+    };
+    for (const char* text : rules) {
+        RecurrenceRule rule = Rule(text);
+        CHECK(rule.Format() == text);
+        RecurrenceRule again = Rule(rule.Format());
+        CHECK(again.Format() == rule.Format());
+    }
+}
+
+static void TestRecurrenceRejects() {
+    const char* rules[] = {
+        // An nth-weekday rule follows one weekday
+        "FREQ=MONTHLY;BYDAY=2MO,3TU;DTSTART=20240101",
+        "FREQ=MONTHLY;BYDAY=2MO,TU;DTSTART=20240101",
+        // Keys the rule can't keep would change what it means
+        "FREQ=DAILY;COUNT=3;DTSTART=20240101",
+        "FREQ=WEEKLY;BYMONTH=1;DTSTART=20240101",
+        // Every other day, but only on Mondays
+        "FREQ=DAILY;INTERVAL=2;BYDAY=MO;DTSTART=20240101",
+        "FREQ=YEARLY;DTSTART=20240101",
+        "FREQ=MONTHLY;BYMONTHDAY=32;DTSTART=20240101",
+        "FREQ=WEEKLY;BYDAY=XX;DTSTART=20240101",
+        "FREQ=DAILY;DTSTART=20240230",
+        "FREQ=DAILY;DTSTART",
+    };
+    for (const char* text : rules) {
+        RecurrenceRule rule;
+        if (rule.Parse(text)) {
+            fprintf(stderr, "accepted %s\n", text);
+            failures++;
+        }
+    }
+}
+
+// --- LocalTimeZone ---
+
+static time_t Utc(int year, int month, int day, int hour, int minute) {
+    return (time_t)Day(year, month, day) * 86400 + hour * 3600 + minute * 60;
+}
+
+static int64_t LocalMinuteOf(int year, int month, int day, int hour, int minute) {
+    return (int64_t)Day(year, month, day) * 1440 + hour * 60 + minute;
+}
+
+static void TestLocalTimeZoneToUtc() {
+    // Central European time without needing the zone database: clocks go
+    // forward at 02:00 on 2024-03-31 and back at 03:00 on 2024-10-27
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+    LocalTimeZone zone;
+    zone.Refresh(Utc(2024, 3, 1, 12, 0));
+
+    CHECK(zone.OffsetAt(Utc(2024, 3, 1, 12, 0)) == 3600);
+    CHECK(zone.OffsetAt(Utc(2024, 7, 1, 12, 0)) == 7200);
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 1, 7, 30)) == Utc(2024, 3, 1, 6, 30));
+
+    // Spring forward: 02:00-02:59 never happen and map to the change itself
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 31, 1, 59)) == Utc(2024, 3, 31, 0, 59));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 31, 2, 0)) == Utc(2024, 3, 31, 1, 0));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 31, 2, 30)) == Utc(2024, 3, 31, 1, 0));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 31, 3, 0)) == Utc(2024, 3, 31, 1, 0));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 3, 31, 3, 1)) == Utc(2024, 3, 31, 1, 1));
+
+    // Fall back: 02:00-02:59 happen twice and map to the first time
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 10, 27, 1, 59)) == Utc(2024, 10, 26, 23, 59));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 10, 27, 2, 30)) == Utc(2024, 10, 27, 0, 30));
+    CHECK(zone.ToUtc(LocalMinuteOf(2024, 10, 27, 3, 0)) == Utc(2024, 10, 27, 2, 0));
+    CHECK(zone.LocalMinute(Utc(2024, 10, 27, 0, 30)) == zone.LocalMinute(Utc(2024, 10, 27, 1, 30)));
+
+    for (time_t when : {Utc(2024, 3, 31, 0, 59), Utc(2024, 3, 31, 1, 0), Utc(2024, 10, 27, 2, 0)}) {
+        CHECK(zone.ToUtc(zone.LocalMinute(when)) == when);
+    }
+}
+
+// --- CSV ---
+
+// A read-only stream over `text`
+static FILE* Stream(const std::string& text) {
+    FILE* file = tmpfile();
+    fputs(text.c_str(), file);
+    rewind(file);
+    return file;
+}
+
+static void TestCsvRecords() {
+    FILE* in = Stream("time,day\r\n"
+                      "07:30,Monday\n"
+                      "08:00,Tuesday,,\"two\n"
+                      "lines, with \"\"quotes\"\"\"\n"
+                      "09:00,\"Every Day\",,\"unterminated\n"
+                      "tail");
+    std::string record;
+    std::vector<std::string> fields;
+    int lines = 0;
+
+    CHECK(ReadCsvRecord(in, &record, &lines) && lines == 1 && record == "time,day");
+    CHECK(ReadCsvRecord(in, &record, &lines) && lines == 1 && record == "07:30,Monday");
+    SplitCsv(record, &fields);
+    CHECK(fields == std::vector<std::string>({"07:30", "Monday"}));
+
+    CHECK(ReadCsvRecord(in, &record, &lines) && lines == 2);
+    SplitCsv(record, &fields);
+    CHECK(fields == std::vector<std::string>({"08:00", "Tuesday", "", "two\nlines, with \"quotes\""}));
+
+    // A quote left open takes the rest of the file
+    CHECK(ReadCsvRecord(in, &record, &lines) && lines == 2);
+    SplitCsv(record, &fields);
+    CHECK(fields.size() == 4 && fields[3] == "unterminated\ntail");
+    CHECK(!ReadCsvRecord(in, &record, &lines));
+    fclose(in);
+
+    SplitCsv("", &fields);
+    CHECK(fields == std::vector<std::string>({""}));
+    SplitCsv("a,,\"b,c\"", &fields);
+    CHECK(fields == std::vector<std::string>({"a", "", "b,c"}));
+}
+
+static void TestCsvAlarms() {
+    int minuteOfDay = -1;
+    RecurrenceRule rule;
+    CHECK(ParseCsvAlarm({"07:30", "Monday"}, 1u << 1, &minuteOfDay, &rule));
+    CHECK(minuteOfDay == 7 * 60 + 30 && rule.IsPlainWeekly() && rule.weekdays == 1u << 1);
+
+    CHECK(ParseCsvAlarm({"23:59", "", "FREQ=DAILY;INTERVAL=2;DTSTART=20240101"}, 0, &minuteOfDay, &rule));
+    CHECK(minuteOfDay == 23 * 60 + 59 && rule.frequency == RecurrenceRule::Daily && rule.interval == 2);
+
+    // Rejected records come back with a time of 0, not whatever was on the stack
+    std::vector<std::vector<std::string>> rejected = {
+        {"7:3x", "Monday"},
+        {"25:00", "Monday"},
+        {"07:60", "Monday"},
+        {"07:30"},
+        {"07:30", "Someday"},
+        {"07:30", "", "FREQ=DAILY;COUNT=3;DTSTART=20240101"},
+    };
+    for (const auto& fields : rejected) {
+        minuteOfDay = -1;
+        unsigned dayMask = fields.size() >= 2 && fields[1] == "Monday" ? 1u << 1 : 0;
+        CHECK(!ParseCsvAlarm(fields, dayMask, &minuteOfDay, &rule));
+        CHECK(minuteOfDay == 0);
+    }
+}
+
+// --- EncryptedVfs ---
+
+// The -rekey journal as EncryptedVfs::Rekeyer writes it
+struct Journal {
+    unsigned char magic[8];
+    uint64_t offset;
+    uint32_t pages;
+    uint32_t reserved;
+    unsigned char digest[32];
+};
+
+static bool WriteJournal(const std::string& path, uint64_t offset, const std::vector<unsigned char>& pages,
+                         bool complete) {
+    Journal header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "ALRMRKJ1", sizeof(header.magic));
+    header.offset = offset;
+    header.pages = (uint32_t)(pages.size() / EncryptedVfs::kPageSize);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1 &&
+              EVP_DigestUpdate(ctx, &header, offsetof(Journal, digest)) == 1 &&
+              EVP_DigestUpdate(ctx, pages.data(), pages.size()) == 1 &&
+              EVP_DigestFinal_ex(ctx, header.digest, nullptr) == 1;
+    EVP_MD_CTX_free(ctx);
+
+    FILE* journal = fopen(path.c_str(), "wb");
+    ok = ok && journal && fwrite(&header, sizeof(header), 1, journal) == 1 &&
+         fwrite(pages.data(), complete ? pages.size() : pages.size() / 2, 1, journal) == 1;
+    return journal && fclose(journal) == 0 && ok;
+}
+
+static std::vector<unsigned char> ReadBytes(const std::string& path, long offset, size_t size) {
+    std::vector<unsigned char> bytes(size);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file || fseek(file, offset, SEEK_SET) != 0 || fread(bytes.data(), size, 1, file) != 1) {
+        bytes.clear();
+    }
+    if (file) {
+        fclose(file);
+    }
+    return bytes;
+}
+
+static bool Exists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) {
+        fclose(file);
+    }
+    return file != nullptr;
+}
+
+static void WriteBytes(const std::string& path, long offset, const std::vector<unsigned char>& bytes) {
+    FILE* file = fopen(path.c_str(), "r+b");
+    CHECK(file && fseek(file, offset, SEEK_SET) == 0 && fwrite(bytes.data(), bytes.size(), 1, file) == 1);
+    if (file) {
+        fclose(file);
+    }
+}
+
+static sqlite3* OpenEncrypted(const char* path) {
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, EncryptedVfs::Name()) != SQLITE_OK) {
+        sqlite3_close(db);
+        return nullptr;
+    }
+    int reserve = EncryptedVfs::kReserve;
+    std::string pageSize = "PRAGMA page_size = " + std::to_string(EncryptedVfs::kPageSize) + ";";
+    sqlite3_exec(db, pageSize.c_str(), 0, 0, 0);
+    sqlite3_file_control(db, "main", SQLITE_FCNTL_RESERVE_BYTES, &reserve);
+    return db;
+}
+
+// Rows in the test table, or -1 if the database doesn't read back whole
+static int CountRows(const char* path) {
+    sqlite3* db = OpenEncrypted(path);
+    sqlite3_stmt* stmt = nullptr;
+    int rows = -1;
+    if (db && sqlite3_prepare_v2(db, "PRAGMA integrity_check;", -1, &stmt, 0) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW && strcmp((const char*)sqlite3_column_text(stmt, 0), "ok") == 0) {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+        if (sqlite3_prepare_v2(db, "SELECT count(*) FROM alarms;", -1, &stmt, 0) == SQLITE_OK &&
+            sqlite3_step(stmt) == SQLITE_ROW) {
+            rows = sqlite3_column_int(stmt, 0);
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return rows;
+}
+
+static void TestEncryptedVfsRecover() {
+    const char* path = "alarm_core_test.db";
+    const std::string journalPath = std::string(path) + "-rekey";
+    for (const char* suffix : {"", "-journal", "-wal", "-shm", "-rekey"}) {
+        remove((std::string(path) + suffix).c_str());
+    }
+    unsigned char key[EncryptedVfs::kKeySize];
+    for (int i = 0; i < EncryptedVfs::kKeySize; i++) {
+        key[i] = (unsigned char)(i * 7 + 1);
+    }
+    CHECK(EncryptedVfs::SetKey(path, key));
+
+    sqlite3* db = OpenEncrypted(path);
+    CHECK(db != nullptr);
+    CHECK(sqlite3_exec(db, "CREATE TABLE alarms (id INTEGER PRIMARY KEY, label TEXT);", 0, 0, 0) == SQLITE_OK);
+    CHECK(sqlite3_exec(db, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 2000) "
+                           "INSERT INTO alarms (label) SELECT printf('alarm %d %0100d', i, i) FROM n;",
+                       0, 0, 0) == SQLITE_OK);
+    sqlite3_close(db);
+    CHECK(CountRows(path) == 2000);
+
+    // A batch of pages 2-9 journaled, then torn part way through writing back
+    const int pages = 8;
+    const long offset = 1L * EncryptedVfs::kPageSize;
+    std::vector<unsigned char> before = ReadBytes(path, offset, (size_t)pages * EncryptedVfs::kPageSize);
+    CHECK(!before.empty());
+    CHECK(WriteJournal(journalPath, offset, before, true));
+    WriteBytes(path, offset + EncryptedVfs::kPageSize / 2,
+               std::vector<unsigned char>(EncryptedVfs::kPageSize * 3, 0xA5));
+    CHECK(CountRows(path) == -1);
+
+    CHECK(EncryptedVfs::Recover(path));
+    CHECK(!Exists(journalPath));
+    CHECK(ReadBytes(path, offset, before.size()) == before);
+    CHECK(CountRows(path) == 2000);
+
+    // A journal cut short was never synced, so the database was never
+    // touched and the journal is just dropped
+    std::vector<unsigned char> garbage(before.size(), 0x5A);
+    CHECK(WriteJournal(journalPath, offset, garbage, false));
+    CHECK(EncryptedVfs::Recover(path));
+    CHECK(!Exists(journalPath));
+    CHECK(ReadBytes(path, offset, before.size()) == before);
+
+    // So is one whose pages don't match its digest
+    CHECK(WriteJournal(journalPath, offset, garbage, true));
+    WriteBytes(journalPath, sizeof(Journal) + 10, std::vector<unsigned char>(1, 0));
+    CHECK(EncryptedVfs::Recover(path));
+    CHECK(ReadBytes(path, offset, before.size()) == before);
+    CHECK(CountRows(path) == 2000);
+
+    // Nothing to recover
+    CHECK(EncryptedVfs::Recover(path));
+
+    EncryptedVfs::RemoveKey(path);
+    for (const char* suffix : {"", "-journal", "-wal", "-shm", "-rekey"}) {
+        remove((std::string(path) + suffix).c_str());
+    }
+}
+
+static const struct {
+    const char* name;
+    void (*run)();
+} kTests[] = {
+    {"timing_wheel_insert", TestTimingWheelInsert},
+    {"timing_wheel_cancel", TestTimingWheelCancel},
+    {"timing_wheel_cascade", TestTimingWheelCascade},
+    {"timing_wheel_next_tick", TestTimingWheelNextTick},
+    {"recurrence_next_day", TestRecurrenceNextDay},
+    {"recurrence_round_trip", TestRecurrenceRoundTrip},
+    {"recurrence_rejects", TestRecurrenceRejects},
+    {"local_time_zone_to_utc", TestLocalTimeZoneToUtc},
+    {"csv_records", TestCsvRecords},
+    {"csv_alarms", TestCsvAlarms},
+    {"encrypted_vfs_recover", TestEncryptedVfsRecover},
+};
+
+int main(int argc, char** argv) {
+    std::set<std::string> wanted(argv + 1, argv + argc);
+    int ran = 0;
+    for (const auto& test : kTests) {
+        if (wanted.empty() || wanted.count(test.name)) {
+            int before = failures;
+            test.run();
+            printf("%s %s\n", failures == before ? "PASS" : "FAIL", test.name);
+            ran++;
+        }
+    }
+    if (ran == 0) {
+        fprintf(stderr, "no such test\n");
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}